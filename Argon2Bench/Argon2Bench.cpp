@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <sodium.h>
+#include "Argon2.h"
+
+using Argon2::Kernel;
+
+constexpr Kernel Kernels[] = { Kernel::Portable, Kernel::Ssse3, Kernel::Avx2, Kernel::Avx512 };
+
+// single lane is checked against libsodium
+// four lanes against reference libargon2, argon2id_hash_raw(3, 64, 4, "password", 16 x 0x02)
+static bool SelfTest(Kernel kernel)
+{
+	const std::string_view password = "password";
+	unsigned char salt[16];
+	memset(salt, 2, sizeof(salt));
+
+	unsigned char expected[32];
+	if (crypto_pwhash(expected, sizeof(expected), password.data(), password.size(), salt, 3, 256 * 1024, crypto_pwhash_ALG_ARGON2ID13) < 0)
+		return false;
+
+	const unsigned char expectedLanes[32] = {
+		0x69, 0x06, 0xf9, 0x9d, 0x4e, 0x03, 0x81, 0x9d, 0x8e, 0xde, 0x5d, 0x80, 0x6b, 0x4b, 0xf5, 0xa2,
+		0x10, 0x07, 0x41, 0xe2, 0xc7, 0x16, 0x73, 0x4a, 0x9a, 0x90, 0xed, 0x99, 0xbf, 0x85, 0xbd, 0xed,
+	};
+
+	unsigned char hash[32];
+	if (!Argon2::HashWith(kernel, hash, sizeof(hash), password, salt, sizeof(salt), 3, 256, 1) || memcmp(hash, expected, sizeof(hash)) != 0)
+		return false;
+
+	return Argon2::HashWith(kernel, hash, sizeof(hash), password, salt, sizeof(salt), 3, 64, 4) && memcmp(hash, expectedLanes, sizeof(hash)) == 0;
+}
+
+// best of a few runs in milliseconds, negative on failure
+template<typename F>
+static double Time(F&& hash)
+{
+	constexpr int Runs = 5;
+	auto best = std::chrono::duration<double, std::milli>::max();
+	for (int i = 0; i < Runs; ++i)
+	{
+		auto start = std::chrono::steady_clock::now();
+		if (!hash())
+			return -1.0;
+		best = std::min<std::chrono::duration<double, std::milli>>(best, std::chrono::steady_clock::now() - start);
+	}
+	return best.count();
+}
+
+int main()
+{
+	if (sodium_init() < 0)
+		return 1;
+
+#if _DEBUG
+	printf("debug build, times below say nothing about release speed\n");
+#endif
+
+	bool failed = false;
+	for (auto kernel : Kernels)
+	{
+		if (!Argon2::IsKernelAvailable(kernel))
+			continue;
+
+		bool passed = SelfTest(kernel);
+		printf("%-9s known answers: %s\n", Argon2::GetKernelName(kernel), passed ? "ok" : "FAILED");
+		failed |= !passed;
+	}
+
+	// default costs of a sensitive vault scaled down: 64 MiB, 3 passes
+	constexpr uint32_t Memory = 64 * 1024;
+	constexpr uint32_t Passes = 3;
+	const std::string_view password = "password";
+	unsigned char salt[crypto_pwhash_SALTBYTES]{};
+	unsigned char hash[32];
+
+	auto sodium = Time([&]() { return crypto_pwhash(hash, sizeof(hash), password.data(), password.size(), salt, Passes, (size_t)Memory * 1024, crypto_pwhash_ALG_ARGON2ID13) == 0; });
+	printf("\n64 MiB, 3 passes\n%-14s 1 lane  %8.1f ms\n", "crypto_pwhash", sodium);
+
+	for (auto kernel : Kernels)
+	{
+		if (!Argon2::IsKernelAvailable(kernel))
+			continue;
+
+		for (uint32_t lanes : { 1u, 4u })
+		{
+			auto time = Time([&]() { return Argon2::HashWith(kernel, hash, sizeof(hash), password, salt, sizeof(salt), Passes, Memory, lanes); });
+			printf("%-14s %u lane%s %8.1f ms, %.2fx crypto_pwhash\n", Argon2::GetKernelName(kernel), lanes, lanes == 1 ? " " : "s", time, sodium / time);
+		}
+	}
+	return failed ? 1 : 0;
+}
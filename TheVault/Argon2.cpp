@@ -0,0 +1,842 @@
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <immintrin.h>
+#include <sodium.h>
+#include "Argon2.h"
+#include "Cpu.h"
+#include "WinApi.h"
+
+constexpr uint32_t Version = 0x13;
+constexpr uint32_t TypeId = 2;
+constexpr uint32_t SyncPoints = 4;
+constexpr size_t BlockWords = 128;
+constexpr size_t AddressesInBlock = BlockWords;
+constexpr size_t PrehashSize = 64;
+
+struct alignas(64) Block
+{
+	uint64_t v[BlockWords];
+};
+
+using FillFn = void(*)(const Block&, const Block&, Block&, bool);
+
+struct Instance
+{
+	FillFn fill;
+	Block* memory;
+	uint32_t passes;
+	uint32_t lanes;
+	uint32_t laneLength;
+	uint32_t segmentLength;
+	uint32_t blockCount;
+	std::stop_token stop;
+	std::atomic_bool stopped;
+};
+
+constexpr uint32_t StopCheckInterval = 1024;
+
+struct Position
+{
+	uint32_t pass;
+	uint32_t lane;
+	uint32_t slice;
+	uint32_t index;
+};
+
+Argon2::Workspace::Workspace()
+{
+	memory = nullptr;
+	capacity = 0;
+	largePages = false;
+}
+
+Argon2::Workspace::~Workspace()
+{
+	Release();
+}
+
+bool Argon2::Workspace::Reserve(size_t size)
+{
+	if (size <= capacity)
+		return true;
+	Release();
+
+	auto pageSize = WinApi::GetLargePageSize();
+	if (pageSize != 0)
+		size = (size + pageSize - 1) / pageSize * pageSize;
+
+	memory = WinApi::AllocWorkspace(size, largePages);
+	if (!memory)
+		return false;
+	capacity = size;
+	return true;
+}
+
+void Argon2::Workspace::Release()
+{
+	if (!memory)
+		return;
+
+	// hashes wipe what they used, this covers stopped ones and rounding
+	sodium_memzero(memory, capacity);
+	WinApi::FreeWorkspace(memory);
+	memory = nullptr;
+	capacity = 0;
+	largePages = false;
+}
+
+static void Store32(unsigned char* out, uint32_t value)
+{
+	for (int i = 0; i < 4; ++i)
+		out[i] = (unsigned char)(value >> (i * 8));
+}
+
+static void Blake2bUpdate32(crypto_generichash_blake2b_state& state, uint32_t value)
+{
+	unsigned char buff[4];
+	Store32(buff, value);
+	crypto_generichash_blake2b_update(&state, buff, sizeof(buff));
+}
+
+// variable length hash H' from rfc 9106
+static void HashLong(unsigned char* out, size_t outSize, const unsigned char* in, size_t inSize)
+{
+	crypto_generichash_blake2b_state state;
+	unsigned char outLen[4];
+	Store32(outLen, (uint32_t)outSize);
+
+	if (outSize <= crypto_generichash_blake2b_BYTES_MAX)
+	{
+		crypto_generichash_blake2b_init(&state, nullptr, 0, outSize);
+		crypto_generichash_blake2b_update(&state, outLen, sizeof(outLen));
+		crypto_generichash_blake2b_update(&state, in, inSize);
+		crypto_generichash_blake2b_final(&state, out, outSize);
+		sodium_memzero(&state, sizeof(state));
+		return;
+	}
+
+	unsigned char v[crypto_generichash_blake2b_BYTES_MAX];
+	crypto_generichash_blake2b_init(&state, nullptr, 0, sizeof(v));
+	crypto_generichash_blake2b_update(&state, outLen, sizeof(outLen));
+	crypto_generichash_blake2b_update(&state, in, inSize);
+	crypto_generichash_blake2b_final(&state, v, sizeof(v));
+
+	constexpr size_t Half = crypto_generichash_blake2b_BYTES_MAX / 2;
+	memcpy(out, v, Half);
+	out += Half;
+	size_t left = outSize - Half;
+
+	while (left > crypto_generichash_blake2b_BYTES_MAX)
+	{
+		crypto_generichash_blake2b(v, sizeof(v), v, sizeof(v), nullptr, 0);
+		memcpy(out, v, Half);
+		out += Half;
+		left -= Half;
+	}
+
+	crypto_generichash_blake2b(out, left, v, sizeof(v), nullptr, 0);
+	sodium_memzero(v, sizeof(v));
+	sodium_memzero(&state, sizeof(state));
+}
+
+static uint64_t RotR(uint64_t w, unsigned int c)
+{
+	return (w >> c) | (w << (64 - c));
+}
+
+static uint64_t BlaMka(uint64_t x, uint64_t y)
+{
+	return x + y + 2 * (uint64_t)(uint32_t)x * (uint32_t)y;
+}
+
+static void G(uint64_t& a, uint64_t& b, uint64_t& c, uint64_t& d)
+{
+	a = BlaMka(a, b);
+	d = RotR(d ^ a, 32);
+	c = BlaMka(c, d);
+	b = RotR(b ^ c, 24);
+	a = BlaMka(a, b);
+	d = RotR(d ^ a, 16);
+	c = BlaMka(c, d);
+	b = RotR(b ^ c, 63);
+}
+
+static void Round(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3, uint64_t& v4, uint64_t& v5, uint64_t& v6, uint64_t& v7,
+	uint64_t& v8, uint64_t& v9, uint64_t& v10, uint64_t& v11, uint64_t& v12, uint64_t& v13, uint64_t& v14, uint64_t& v15)
+{
+	G(v0, v4, v8, v12);
+	G(v1, v5, v9, v13);
+	G(v2, v6, v10, v14);
+	G(v3, v7, v11, v15);
+	G(v0, v5, v10, v15);
+	G(v1, v6, v11, v12);
+	G(v2, v7, v8, v13);
+	G(v3, v4, v9, v14);
+}
+
+// next = G(prev, ref), xored into old content of next after first pass
+static void FillBlock(const Block& prev, const Block& ref, Block& next, bool withXor)
+{
+	Block r, tmp;
+	for (size_t i = 0; i < BlockWords; ++i)
+		r.v[i] = ref.v[i] ^ prev.v[i];
+
+	tmp = r;
+	if (withXor)
+	{
+		for (size_t i = 0; i < BlockWords; ++i)
+			tmp.v[i] ^= next.v[i];
+	}
+
+	auto* v = r.v;
+	for (size_t i = 0; i < 8; ++i)
+	{
+		auto* w = v + 16 * i;
+		Round(w[0], w[1], w[2], w[3], w[4], w[5], w[6], w[7], w[8], w[9], w[10], w[11], w[12], w[13], w[14], w[15]);
+	}
+
+	for (size_t i = 0; i < 8; ++i)
+	{
+		auto* w = v + 2 * i;
+		Round(w[0], w[1], w[16], w[17], w[32], w[33], w[48], w[49], w[64], w[65], w[80], w[81], w[96], w[97], w[112], w[113]);
+	}
+
+	for (size_t i = 0; i < BlockWords; ++i)
+		next.v[i] = tmp.v[i] ^ r.v[i];
+}
+
+// simd kernels follow the layout of the portable one, rows are 16 words and columns are word pairs
+static __m128i BlaMka(__m128i x, __m128i y)
+{
+	auto z = _mm_mul_epu32(x, y);
+	return _mm_add_epi64(_mm_add_epi64(x, y), _mm_add_epi64(z, z));
+}
+
+static void G1(__m128i& a0, __m128i& b0, __m128i& c0, __m128i& d0, __m128i& a1, __m128i& b1, __m128i& c1, __m128i& d1)
+{
+	const auto rot24 = _mm_setr_epi8(3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10);
+
+	a0 = BlaMka(a0, b0);
+	a1 = BlaMka(a1, b1);
+	d0 = _mm_shuffle_epi32(_mm_xor_si128(d0, a0), _MM_SHUFFLE(2, 3, 0, 1));
+	d1 = _mm_shuffle_epi32(_mm_xor_si128(d1, a1), _MM_SHUFFLE(2, 3, 0, 1));
+	c0 = BlaMka(c0, d0);
+	c1 = BlaMka(c1, d1);
+	b0 = _mm_shuffle_epi8(_mm_xor_si128(b0, c0), rot24);
+	b1 = _mm_shuffle_epi8(_mm_xor_si128(b1, c1), rot24);
+}
+
+static void G2(__m128i& a0, __m128i& b0, __m128i& c0, __m128i& d0, __m128i& a1, __m128i& b1, __m128i& c1, __m128i& d1)
+{
+	const auto rot16 = _mm_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9);
+
+	a0 = BlaMka(a0, b0);
+	a1 = BlaMka(a1, b1);
+	d0 = _mm_shuffle_epi8(_mm_xor_si128(d0, a0), rot16);
+	d1 = _mm_shuffle_epi8(_mm_xor_si128(d1, a1), rot16);
+	c0 = BlaMka(c0, d0);
+	c1 = BlaMka(c1, d1);
+	b0 = _mm_xor_si128(b0, c0);
+	b1 = _mm_xor_si128(b1, c1);
+	b0 = _mm_xor_si128(_mm_srli_epi64(b0, 63), _mm_add_epi64(b0, b0));
+	b1 = _mm_xor_si128(_mm_srli_epi64(b1, 63), _mm_add_epi64(b1, b1));
+}
+
+static void Round(__m128i& a0, __m128i& a1, __m128i& b0, __m128i& b1, __m128i& c0, __m128i& c1, __m128i& d0, __m128i& d1)
+{
+	G1(a0, b0, c0, d0, a1, b1, c1, d1);
+	G2(a0, b0, c0, d0, a1, b1, c1, d1);
+
+	auto t0 = _mm_alignr_epi8(b1, b0, 8);
+	auto t1 = _mm_alignr_epi8(b0, b1, 8);
+	b0 = t0;
+	b1 = t1;
+	std::swap(c0, c1);
+	t0 = _mm_alignr_epi8(d1, d0, 8);
+	t1 = _mm_alignr_epi8(d0, d1, 8);
+	d0 = t1;
+	d1 = t0;
+
+	G1(a0, b0, c0, d0, a1, b1, c1, d1);
+	G2(a0, b0, c0, d0, a1, b1, c1, d1);
+
+	t0 = _mm_alignr_epi8(b0, b1, 8);
+	t1 = _mm_alignr_epi8(b1, b0, 8);
+	b0 = t0;
+	b1 = t1;
+	std::swap(c0, c1);
+	t0 = _mm_alignr_epi8(d0, d1, 8);
+	t1 = _mm_alignr_epi8(d1, d0, 8);
+	d0 = t1;
+	d1 = t0;
+}
+
+static void FillBlockSsse3(const Block& prev, const Block& ref, Block& next, bool withXor)
+{
+	constexpr size_t Count = sizeof(Block) / sizeof(__m128i);
+	__m128i r[Count], tmp[Count];
+
+	auto* prevIn = (const __m128i*)prev.v;
+	auto* refIn = (const __m128i*)ref.v;
+	auto* nextIn = (__m128i*)next.v;
+	for (size_t i = 0; i < Count; ++i)
+	{
+		r[i] = _mm_xor_si128(_mm_load_si128(prevIn + i), _mm_load_si128(refIn + i));
+		tmp[i] = withXor ? _mm_xor_si128(r[i], _mm_load_si128(nextIn + i)) : r[i];
+	}
+
+	for (size_t i = 0; i < 8; ++i)
+		Round(r[8 * i], r[8 * i + 1], r[8 * i + 2], r[8 * i + 3], r[8 * i + 4], r[8 * i + 5], r[8 * i + 6], r[8 * i + 7]);
+
+	for (size_t i = 0; i < 8; ++i)
+		Round(r[i], r[8 + i], r[16 + i], r[24 + i], r[32 + i], r[40 + i], r[48 + i], r[56 + i]);
+
+	for (size_t i = 0; i < Count; ++i)
+		_mm_store_si128(nextIn + i, _mm_xor_si128(tmp[i], r[i]));
+}
+
+static __m256i BlaMka(__m256i x, __m256i y)
+{
+	auto z = _mm256_mul_epu32(x, y);
+	return _mm256_add_epi64(_mm256_add_epi64(x, y), _mm256_add_epi64(z, z));
+}
+
+static void G(__m256i& a0, __m256i& b0, __m256i& c0, __m256i& d0, __m256i& a1, __m256i& b1, __m256i& c1, __m256i& d1)
+{
+	const auto rot24 = _mm256_setr_epi8(3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10,
+		3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10);
+	const auto rot16 = _mm256_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9,
+		2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9);
+
+	a0 = BlaMka(a0, b0);
+	a1 = BlaMka(a1, b1);
+	d0 = _mm256_shuffle_epi32(_mm256_xor_si256(d0, a0), _MM_SHUFFLE(2, 3, 0, 1));
+	d1 = _mm256_shuffle_epi32(_mm256_xor_si256(d1, a1), _MM_SHUFFLE(2, 3, 0, 1));
+	c0 = BlaMka(c0, d0);
+	c1 = BlaMka(c1, d1);
+	b0 = _mm256_shuffle_epi8(_mm256_xor_si256(b0, c0), rot24);
+	b1 = _mm256_shuffle_epi8(_mm256_xor_si256(b1, c1), rot24);
+
+	a0 = BlaMka(a0, b0);
+	a1 = BlaMka(a1, b1);
+	d0 = _mm256_shuffle_epi8(_mm256_xor_si256(d0, a0), rot16);
+	d1 = _mm256_shuffle_epi8(_mm256_xor_si256(d1, a1), rot16);
+	c0 = BlaMka(c0, d0);
+	c1 = BlaMka(c1, d1);
+	b0 = _mm256_xor_si256(b0, c0);
+	b1 = _mm256_xor_si256(b1, c1);
+	b0 = _mm256_xor_si256(_mm256_srli_epi64(b0, 63), _mm256_add_epi64(b0, b0));
+	b1 = _mm256_xor_si256(_mm256_srli_epi64(b1, 63), _mm256_add_epi64(b1, b1));
+}
+
+static void RowRound(__m256i& a0, __m256i& b0, __m256i& c0, __m256i& d0, __m256i& a1, __m256i& b1, __m256i& c1, __m256i& d1)
+{
+	G(a0, b0, c0, d0, a1, b1, c1, d1);
+
+	b0 = _mm256_permute4x64_epi64(b0, _MM_SHUFFLE(0, 3, 2, 1));
+	c0 = _mm256_permute4x64_epi64(c0, _MM_SHUFFLE(1, 0, 3, 2));
+	d0 = _mm256_permute4x64_epi64(d0, _MM_SHUFFLE(2, 1, 0, 3));
+	b1 = _mm256_permute4x64_epi64(b1, _MM_SHUFFLE(0, 3, 2, 1));
+	c1 = _mm256_permute4x64_epi64(c1, _MM_SHUFFLE(1, 0, 3, 2));
+	d1 = _mm256_permute4x64_epi64(d1, _MM_SHUFFLE(2, 1, 0, 3));
+
+	G(a0, b0, c0, d0, a1, b1, c1, d1);
+
+	b0 = _mm256_permute4x64_epi64(b0, _MM_SHUFFLE(2, 1, 0, 3));
+	c0 = _mm256_permute4x64_epi64(c0, _MM_SHUFFLE(1, 0, 3, 2));
+	d0 = _mm256_permute4x64_epi64(d0, _MM_SHUFFLE(0, 3, 2, 1));
+	b1 = _mm256_permute4x64_epi64(b1, _MM_SHUFFLE(2, 1, 0, 3));
+	c1 = _mm256_permute4x64_epi64(c1, _MM_SHUFFLE(1, 0, 3, 2));
+	d1 = _mm256_permute4x64_epi64(d1, _MM_SHUFFLE(0, 3, 2, 1));
+}
+
+// column rounds, a register holds two word pairs of one column input so diagonals need blends
+static void ColumnRound(__m256i& a0, __m256i& a1, __m256i& b0, __m256i& b1, __m256i& c0, __m256i& c1, __m256i& d0, __m256i& d1)
+{
+	G(a0, b0, c0, d0, a1, b1, c1, d1);
+
+	auto t0 = _mm256_blend_epi32(b0, b1, 0xcc);
+	auto t1 = _mm256_blend_epi32(b0, b1, 0x33);
+	b1 = _mm256_permute4x64_epi64(t0, _MM_SHUFFLE(2, 3, 0, 1));
+	b0 = _mm256_permute4x64_epi64(t1, _MM_SHUFFLE(2, 3, 0, 1));
+	std::swap(c0, c1);
+	t0 = _mm256_blend_epi32(d0, d1, 0xcc);
+	t1 = _mm256_blend_epi32(d0, d1, 0x33);
+	d0 = _mm256_permute4x64_epi64(t0, _MM_SHUFFLE(2, 3, 0, 1));
+	d1 = _mm256_permute4x64_epi64(t1, _MM_SHUFFLE(2, 3, 0, 1));
+
+	G(a0, b0, c0, d0, a1, b1, c1, d1);
+
+	t0 = _mm256_blend_epi32(b0, b1, 0xcc);
+	t1 = _mm256_blend_epi32(b0, b1, 0x33);
+	b0 = _mm256_permute4x64_epi64(t0, _MM_SHUFFLE(2, 3, 0, 1));
+	b1 = _mm256_permute4x64_epi64(t1, _MM_SHUFFLE(2, 3, 0, 1));
+	std::swap(c0, c1);
+	t0 = _mm256_blend_epi32(d0, d1, 0x33);
+	t1 = _mm256_blend_epi32(d0, d1, 0xcc);
+	d0 = _mm256_permute4x64_epi64(t0, _MM_SHUFFLE(2, 3, 0, 1));
+	d1 = _mm256_permute4x64_epi64(t1, _MM_SHUFFLE(2, 3, 0, 1));
+}
+
+static void FillBlockAvx2(const Block& prev, const Block& ref, Block& next, bool withXor)
+{
+	constexpr size_t Count = sizeof(Block) / sizeof(__m256i);
+	__m256i r[Count], tmp[Count];
+
+	auto* prevIn = (const __m256i*)prev.v;
+	auto* refIn = (const __m256i*)ref.v;
+	auto* nextIn = (__m256i*)next.v;
+	for (size_t i = 0; i < Count; ++i)
+	{
+		r[i] = _mm256_xor_si256(_mm256_load_si256(prevIn + i), _mm256_load_si256(refIn + i));
+		tmp[i] = withXor ? _mm256_xor_si256(r[i], _mm256_load_si256(nextIn + i)) : r[i];
+	}
+
+	for (size_t i = 0; i < 4; ++i)
+		RowRound(r[8 * i], r[8 * i + 1], r[8 * i + 2], r[8 * i + 3], r[8 * i + 4], r[8 * i + 5], r[8 * i + 6], r[8 * i + 7]);
+
+	for (size_t i = 0; i < 4; ++i)
+		ColumnRound(r[i], r[4 + i], r[8 + i], r[12 + i], r[16 + i], r[20 + i], r[24 + i], r[28 + i]);
+
+	for (size_t i = 0; i < Count; ++i)
+		_mm256_store_si256(nextIn + i, _mm256_xor_si256(tmp[i], r[i]));
+
+	// avoids sse transition penalty in callers built without vex
+	_mm256_zeroupper();
+}
+
+static __m512i BlaMka(__m512i x, __m512i y)
+{
+	auto z = _mm512_mul_epu32(x, y);
+	return _mm512_add_epi64(_mm512_add_epi64(x, y), _mm512_add_epi64(z, z));
+}
+
+static void G(__m512i& a0, __m512i& b0, __m512i& c0, __m512i& d0, __m512i& a1, __m512i& b1, __m512i& c1, __m512i& d1)
+{
+	a0 = BlaMka(a0, b0);
+	a1 = BlaMka(a1, b1);
+	d0 = _mm512_ror_epi64(_mm512_xor_si512(d0, a0), 32);
+	d1 = _mm512_ror_epi64(_mm512_xor_si512(d1, a1), 32);
+	c0 = BlaMka(c0, d0);
+	c1 = BlaMka(c1, d1);
+	b0 = _mm512_ror_epi64(_mm512_xor_si512(b0, c0), 24);
+	b1 = _mm512_ror_epi64(_mm512_xor_si512(b1, c1), 24);
+
+	a0 = BlaMka(a0, b0);
+	a1 = BlaMka(a1, b1);
+	d0 = _mm512_ror_epi64(_mm512_xor_si512(d0, a0), 16);
+	d1 = _mm512_ror_epi64(_mm512_xor_si512(d1, a1), 16);
+	c0 = BlaMka(c0, d0);
+	c1 = BlaMka(c1, d1);
+	b0 = _mm512_ror_epi64(_mm512_xor_si512(b0, c0), 63);
+	b1 = _mm512_ror_epi64(_mm512_xor_si512(b1, c1), 63);
+}
+
+static void Round(__m512i& a0, __m512i& b0, __m512i& c0, __m512i& d0, __m512i& a1, __m512i& b1, __m512i& c1, __m512i& d1)
+{
+	G(a0, b0, c0, d0, a1, b1, c1, d1);
+
+	b0 = _mm512_permutex_epi64(b0, _MM_SHUFFLE(0, 3, 2, 1));
+	c0 = _mm512_permutex_epi64(c0, _MM_SHUFFLE(1, 0, 3, 2));
+	d0 = _mm512_permutex_epi64(d0, _MM_SHUFFLE(2, 1, 0, 3));
+	b1 = _mm512_permutex_epi64(b1, _MM_SHUFFLE(0, 3, 2, 1));
+	c1 = _mm512_permutex_epi64(c1, _MM_SHUFFLE(1, 0, 3, 2));
+	d1 = _mm512_permutex_epi64(d1, _MM_SHUFFLE(2, 1, 0, 3));
+
+	G(a0, b0, c0, d0, a1, b1, c1, d1);
+
+	b0 = _mm512_permutex_epi64(b0, _MM_SHUFFLE(2, 1, 0, 3));
+	c0 = _mm512_permutex_epi64(c0, _MM_SHUFFLE(1, 0, 3, 2));
+	d0 = _mm512_permutex_epi64(d0, _MM_SHUFFLE(0, 3, 2, 1));
+	b1 = _mm512_permutex_epi64(b1, _MM_SHUFFLE(2, 1, 0, 3));
+	c1 = _mm512_permutex_epi64(c1, _MM_SHUFFLE(1, 0, 3, 2));
+	d1 = _mm512_permutex_epi64(d1, _MM_SHUFFLE(0, 3, 2, 1));
+}
+
+static void SwapHalves(__m512i& a0, __m512i& a1)
+{
+	auto t0 = _mm512_shuffle_i64x2(a0, a1, _MM_SHUFFLE(1, 0, 1, 0));
+	auto t1 = _mm512_shuffle_i64x2(a0, a1, _MM_SHUFFLE(3, 2, 3, 2));
+	a0 = t0;
+	a1 = t1;
+}
+
+static void SwapQuarters(__m512i& a0, __m512i& a1)
+{
+	const auto order = _mm512_setr_epi64(0, 1, 4, 5, 2, 3, 6, 7);
+	SwapHalves(a0, a1);
+	a0 = _mm512_permutexvar_epi64(order, a0);
+	a1 = _mm512_permutexvar_epi64(order, a1);
+}
+
+static void UnswapQuarters(__m512i& a0, __m512i& a1)
+{
+	const auto order = _mm512_setr_epi64(0, 1, 4, 5, 2, 3, 6, 7);
+	a0 = _mm512_permutexvar_epi64(order, a0);
+	a1 = _mm512_permutexvar_epi64(order, a1);
+	SwapHalves(a0, a1);
+}
+
+static void RowRound(__m512i& a0, __m512i& c0, __m512i& b0, __m512i& d0, __m512i& a1, __m512i& c1, __m512i& b1, __m512i& d1)
+{
+	SwapHalves(a0, b0);
+	SwapHalves(c0, d0);
+	SwapHalves(a1, b1);
+	SwapHalves(c1, d1);
+	Round(a0, b0, c0, d0, a1, b1, c1, d1);
+	SwapHalves(a0, b0);
+	SwapHalves(c0, d0);
+	SwapHalves(a1, b1);
+	SwapHalves(c1, d1);
+}
+
+static void ColumnRound(__m512i& a0, __m512i& a1, __m512i& b0, __m512i& b1, __m512i& c0, __m512i& c1, __m512i& d0, __m512i& d1)
+{
+	SwapQuarters(a0, a1);
+	SwapQuarters(b0, b1);
+	SwapQuarters(c0, c1);
+	SwapQuarters(d0, d1);
+	Round(a0, b0, c0, d0, a1, b1, c1, d1);
+	UnswapQuarters(a0, a1);
+	UnswapQuarters(b0, b1);
+	UnswapQuarters(c0, c1);
+	UnswapQuarters(d0, d1);
+}
+
+static void FillBlockAvx512(const Block& prev, const Block& ref, Block& next, bool withXor)
+{
+	constexpr size_t Count = sizeof(Block) / sizeof(__m512i);
+	__m512i r[Count], tmp[Count];
+
+	auto* prevIn = (const __m512i*)prev.v;
+	auto* refIn = (const __m512i*)ref.v;
+	auto* nextIn = (__m512i*)next.v;
+	for (size_t i = 0; i < Count; ++i)
+	{
+		r[i] = _mm512_xor_si512(_mm512_load_si512(prevIn + i), _mm512_load_si512(refIn + i));
+		tmp[i] = withXor ? _mm512_xor_si512(r[i], _mm512_load_si512(nextIn + i)) : r[i];
+	}
+
+	for (size_t i = 0; i < 2; ++i)
+		RowRound(r[8 * i], r[8 * i + 1], r[8 * i + 2], r[8 * i + 3], r[8 * i + 4], r[8 * i + 5], r[8 * i + 6], r[8 * i + 7]);
+
+	for (size_t i = 0; i < 2; ++i)
+		ColumnRound(r[i], r[2 + i], r[4 + i], r[6 + i], r[8 + i], r[10 + i], r[12 + i], r[14 + i]);
+
+	for (size_t i = 0; i < Count; ++i)
+		_mm512_store_si512(nextIn + i, _mm512_xor_si512(tmp[i], r[i]));
+
+	_mm256_zeroupper();
+}
+
+static FillFn GetFill(Argon2::Kernel kernel)
+{
+	switch (kernel)
+	{
+	case Argon2::Kernel::Avx512:
+		return FillBlockAvx512;
+	case Argon2::Kernel::Avx2:
+		return FillBlockAvx2;
+	case Argon2::Kernel::Ssse3:
+		return FillBlockSsse3;
+	default:
+		return FillBlock;
+	}
+}
+
+static void NextAddresses(FillFn fill, Block& address, Block& input, const Block& zero)
+{
+	++input.v[6];
+	fill(zero, input, address, false);
+	fill(zero, address, address, false);
+}
+
+static uint32_t IndexAlpha(const Instance& instance, const Position& position, uint32_t pseudoRand, bool sameLane)
+{
+	uint32_t areaSize;
+	if (position.pass == 0)
+	{
+		if (position.slice == 0)
+			areaSize = position.index - 1;
+		else if (sameLane)
+			areaSize = position.slice * instance.segmentLength + position.index - 1;
+		else
+			areaSize = position.slice * instance.segmentLength + (position.index == 0 ? -1 : 0);
+	}
+	else
+	{
+		if (sameLane)
+			areaSize = instance.laneLength - instance.segmentLength + position.index - 1;
+		else
+			areaSize = instance.laneLength - instance.segmentLength + (position.index == 0 ? -1 : 0);
+	}
+
+	uint64_t relative = pseudoRand;
+	relative = relative * relative >> 32;
+	relative = areaSize - 1 - (areaSize * relative >> 32);
+
+	uint32_t start = 0;
+	if (position.pass != 0)
+		start = position.slice == SyncPoints - 1 ? 0 : (position.slice + 1) * instance.segmentLength;
+
+	return (uint32_t)((start + relative) % instance.laneLength);
+}
+
+static void FillSegment(Instance& instance, Position position)
+{
+	Block address, input, zero;
+	bool independent = position.pass == 0 && position.slice < SyncPoints / 2;
+	if (independent)
+	{
+		memset(&zero, 0, sizeof(zero));
+		memset(&input, 0, sizeof(input));
+		input.v[0] = position.pass;
+		input.v[1] = position.lane;
+		input.v[2] = position.slice;
+		input.v[3] = instance.blockCount;
+		input.v[4] = instance.passes;
+		input.v[5] = TypeId;
+	}
+
+	uint32_t start = 0;
+	if (position.pass == 0 && position.slice == 0)
+	{
+		start = 2;
+		if (independent)
+			NextAddresses(instance.fill, address, input, zero);
+	}
+
+	uint32_t current = position.lane * instance.laneLength + position.slice * instance.segmentLength + start;
+	uint32_t previous = current % instance.laneLength == 0 ? current + instance.laneLength - 1 : current - 1;
+
+	for (uint32_t i = start; i < instance.segmentLength; ++i, ++current, ++previous)
+	{
+		if (i % StopCheckInterval == 0 && instance.stop.stop_requested())
+		{
+			instance.stopped = true;
+			break;
+		}
+
+		if (current % instance.laneLength == 1)
+			previous = current - 1;
+
+		uint64_t pseudoRand;
+		if (independent)
+		{
+			if (i % AddressesInBlock == 0)
+				NextAddresses(instance.fill, address, input, zero);
+			pseudoRand = address.v[i % AddressesInBlock];
+		}
+		else
+			pseudoRand = instance.memory[previous].v[0];
+
+		uint32_t refLane = (uint32_t)((pseudoRand >> 32) % instance.lanes);
+		if (position.pass == 0 && position.slice == 0)
+			refLane = position.lane;
+
+		position.index = i;
+		uint32_t refIndex = IndexAlpha(instance, position, (uint32_t)pseudoRand, refLane == position.lane);
+
+		auto& ref = instance.memory[(size_t)instance.laneLength * refLane + refIndex];
+		instance.fill(instance.memory[previous], ref, instance.memory[current], position.pass != 0);
+	}
+
+	if (independent)
+	{
+		sodium_memzero(&address, sizeof(address));
+		sodium_memzero(&input, sizeof(input));
+	}
+}
+
+static void InitialHash(unsigned char* h0, const std::string_view& password, const unsigned char* salt, size_t saltSize,
+	uint32_t passes, uint32_t memory, uint32_t lanes, uint32_t outSize)
+{
+	crypto_generichash_blake2b_state state;
+	crypto_generichash_blake2b_init(&state, nullptr, 0, PrehashSize);
+	Blake2bUpdate32(state, lanes);
+	Blake2bUpdate32(state, outSize);
+	Blake2bUpdate32(state, memory);
+	Blake2bUpdate32(state, passes);
+	Blake2bUpdate32(state, Version);
+	Blake2bUpdate32(state, TypeId);
+	Blake2bUpdate32(state, (uint32_t)password.size());
+	crypto_generichash_blake2b_update(&state, (const unsigned char*)password.data(), password.size());
+	Blake2bUpdate32(state, (uint32_t)saltSize);
+	crypto_generichash_blake2b_update(&state, salt, saltSize);
+	// no secret and no associated data
+	Blake2bUpdate32(state, 0);
+	Blake2bUpdate32(state, 0);
+	crypto_generichash_blake2b_final(&state, h0, PrehashSize);
+	sodium_memzero(&state, sizeof(state));
+}
+
+bool Argon2::HashWith(Kernel kernel, unsigned char* out, size_t outSize, const std::string_view& password, const unsigned char* salt, size_t saltSize,
+	uint32_t passes, uint32_t memory, uint32_t lanes, std::stop_token stop, Workspace* workspace)
+{
+	if (!out || outSize < 4 || outSize > UINT32_MAX || !salt || saltSize < 8 || saltSize > UINT32_MAX || password.size() > UINT32_MAX)
+		return false;
+
+	if (passes == 0 || lanes == 0 || lanes > 0xffffff || memory < 2 * SyncPoints * lanes)
+		return false;
+
+	Instance instance{};
+	instance.fill = GetFill(kernel);
+	instance.stop = stop;
+	instance.passes = passes;
+	instance.lanes = lanes;
+	instance.segmentLength = memory / (lanes * SyncPoints);
+	instance.laneLength = instance.segmentLength * SyncPoints;
+	instance.blockCount = instance.laneLength * lanes;
+
+	std::unique_ptr<Block[]> blocks;
+	if (workspace)
+	{
+		if (!workspace->Reserve(sizeof(Block) * instance.blockCount))
+			return false;
+		instance.memory = (Block*)workspace->data();
+	}
+	else
+	{
+		blocks.reset(new (std::nothrow) Block[instance.blockCount]);
+		if (!blocks)
+			return false;
+		instance.memory = blocks.get();
+	}
+
+	unsigned char h0[PrehashSize + 8];
+	InitialHash(h0, password, salt, saltSize, passes, memory, lanes, (uint32_t)outSize);
+
+	unsigned char blockBytes[sizeof(Block)];
+	for (uint32_t lane = 0; lane < lanes; ++lane)
+	{
+		for (uint32_t i = 0; i < 2; ++i)
+		{
+			Store32(h0 + PrehashSize, i);
+			Store32(h0 + PrehashSize + 4, lane);
+			HashLong(blockBytes, sizeof(blockBytes), h0, sizeof(h0));
+
+			auto& block = instance.memory[(size_t)lane * instance.laneLength + i];
+			memcpy(block.v, blockBytes, sizeof(blockBytes));
+		}
+	}
+	sodium_memzero(h0, sizeof(h0));
+
+	// lanes of one slice are independent, slices are synchronized by the barrier
+	// barrier latches the stop flag while all lanes wait, so every lane leaves at the same slice
+	bool halt = false;
+	uint32_t filled = 0;
+	auto latchStop = [&instance, &halt, &filled]() noexcept
+	{
+		halt = instance.stopped;
+		++filled;
+	};
+
+	auto fillLane = [&instance, &halt, &latchStop](uint32_t lane, std::barrier<decltype(latchStop)>* sync)
+	{
+		for (uint32_t pass = 0; pass < instance.passes; ++pass)
+		{
+			for (uint32_t slice = 0; slice < SyncPoints; ++slice)
+			{
+				FillSegment(instance, { pass, lane, slice, 0 });
+				if (sync)
+					sync->arrive_and_wait();
+				else
+					latchStop();
+
+				if (halt)
+					return;
+			}
+		}
+	};
+
+	if (lanes == 1)
+		fillLane(0, nullptr);
+	else
+	{
+		std::barrier sync(lanes, latchStop);
+		std::vector<std::jthread> threads;
+		threads.reserve(lanes - 1);
+		for (uint32_t lane = 1; lane < lanes; ++lane)
+			threads.emplace_back(fillLane, lane, &sync);
+
+		fillLane(0, &sync);
+	}
+
+	if (halt)
+	{
+		// wiping untouched pages would fault all of them in
+		auto touched = std::min(filled, SyncPoints) * instance.segmentLength;
+		for (uint32_t lane = 0; lane < lanes; ++lane)
+			sodium_memzero(instance.memory + (size_t)lane * instance.laneLength, sizeof(Block) * touched);
+		return false;
+	}
+
+	Block result = instance.memory[instance.laneLength - 1];
+	for (uint32_t lane = 1; lane < lanes; ++lane)
+	{
+		auto& last = instance.memory[(size_t)lane * instance.laneLength + instance.laneLength - 1];
+		for (size_t i = 0; i < BlockWords; ++i)
+			result.v[i] ^= last.v[i];
+	}
+
+	memcpy(blockBytes, result.v, sizeof(blockBytes));
+	HashLong(out, outSize, blockBytes, sizeof(blockBytes));
+
+	sodium_memzero(blockBytes, sizeof(blockBytes));
+	sodium_memzero(&result, sizeof(result));
+	sodium_memzero(instance.memory, sizeof(Block) * instance.blockCount);
+	return true;
+}
+
+bool Argon2::Hash(unsigned char* out, size_t outSize, const std::string_view& password, const unsigned char* salt, size_t saltSize,
+	uint32_t passes, uint32_t memory, uint32_t lanes, std::stop_token stop, Workspace* workspace)
+{
+	static const auto kernel = BestKernel();
+	return HashWith(kernel, out, outSize, password, salt, saltSize, passes, memory, lanes, stop, workspace);
+}
+
+Argon2::Kernel Argon2::BestKernel()
+{
+	for (auto kernel : { Kernel::Avx512, Kernel::Avx2, Kernel::Ssse3 })
+	{
+		if (IsKernelAvailable(kernel))
+			return kernel;
+	}
+	return Kernel::Portable;
+}
+
+bool Argon2::IsKernelAvailable(Kernel kernel)
+{
+	switch (kernel)
+	{
+	case Kernel::Avx512:
+		return Cpu::HasAvx512();
+	case Kernel::Avx2:
+		return Cpu::HasAvx2();
+	case Kernel::Ssse3:
+		return Cpu::HasSsse3();
+	default:
+		return true;
+	}
+}
+
+const char* Argon2::GetKernelName(Kernel kernel)
+{
+	switch (kernel)
+	{
+	case Kernel::Avx512:
+		return "avx-512";
+	case Kernel::Avx2:
+		return "avx2";
+	case Kernel::Ssse3:
+		return "ssse3";
+	default:
+		return "portable";
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <stop_token>
+#include <string>
+
+namespace Argon2
+{
+	// hashing memory kept between calls, faulted in once and wiped after every hash
+	class Workspace
+	{
+	private:
+		void* memory;
+		size_t capacity;
+		bool largePages;
+
+	public:
+		Workspace();
+		~Workspace();
+		Workspace(const Workspace&) = delete;
+		Workspace& operator=(const Workspace&) = delete;
+
+		bool Reserve(size_t size);
+		void Release();
+
+		void* data() { return memory; }
+		size_t size() { return capacity; }
+		bool HasLargePages() { return largePages; }
+	};
+
+	enum class Kernel
+	{
+		Portable,
+		Ssse3,
+		Avx2,
+		Avx512
+	};
+
+	Kernel BestKernel();
+	bool IsKernelAvailable(Kernel kernel);
+	const char* GetKernelName(Kernel kernel);
+
+	// argon2id v1.3 as in rfc 9106 without secret and associated data, every lane is filled by its own thread
+	// output matches crypto_pwhash for single lane with memory given in KiB
+	// stop is checked between slices, stopped hash returns false
+	// without workspace the memory is allocated for this call only
+	bool Hash(unsigned char* out, size_t outSize, const std::string_view& password, const unsigned char* salt, size_t saltSize,
+		uint32_t passes, uint32_t memory, uint32_t lanes, std::stop_token stop = {}, Workspace* workspace = nullptr);
+	// same with given kernel, Argon2Bench checks and times every one of them
+	bool HashWith(Kernel kernel, unsigned char* out, size_t outSize, const std::string_view& password, const unsigned char* salt, size_t saltSize,
+		uint32_t passes, uint32_t memory, uint32_t lanes, std::stop_token stop = {}, Workspace* workspace = nullptr);
+};
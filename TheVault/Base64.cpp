@@ -0,0 +1,184 @@
+#include <array>
+#include <immintrin.h>
+#include "Base64.h"
+#include "Cpu.h"
+
+static constexpr std::array<signed char, 256> DecodeTable = []()
+{
+	std::array<signed char, 256> table{};
+	table.fill(-1);
+	for (int i = 0; i < 26; ++i)
+	{
+		table['A' + i] = (signed char)i;
+		table['a' + i] = (signed char)(26 + i);
+	}
+	for (int i = 0; i < 10; ++i)
+		table['0' + i] = (signed char)(52 + i);
+	table['-'] = 62;
+	table['_'] = 63;
+	return table;
+}();
+
+static __m128i InRange(__m128i in, char lo, char hi)
+{
+	return _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8(lo - 1)), _mm_cmpgt_epi8(_mm_set1_epi8(hi + 1), in));
+}
+
+static __m256i InRange(__m256i in, char lo, char hi)
+{
+	return _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8(lo - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), in));
+}
+
+// simd blocks turn 16 chars into 12 bytes (https://arxiv.org/abs/1704.00605)
+// writes 16 bytes, 12 are valid
+static bool DecodeSsse3(const char* text, size_t size, unsigned char* out, size_t& done)
+{
+	const auto shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+	size_t i = 0;
+	for (; size - i >= 24; i += 16, out += 12)
+	{
+		auto in = _mm_loadu_si128((const __m128i*)(text + i));
+
+		auto upper = InRange(in, 'A', 'Z');
+		auto lower = InRange(in, 'a', 'z');
+		auto digit = InRange(in, '0', '9');
+		auto dash = _mm_cmpeq_epi8(in, _mm_set1_epi8('-'));
+		auto underscore = _mm_cmpeq_epi8(in, _mm_set1_epi8('_'));
+
+		auto valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(_mm_or_si128(digit, dash), underscore));
+		if (_mm_movemask_epi8(valid) != 0xffff)
+			return false;
+
+		auto shift = _mm_and_si128(upper, _mm_set1_epi8(-'A'));
+		shift = _mm_or_si128(shift, _mm_and_si128(lower, _mm_set1_epi8(26 - 'a')));
+		shift = _mm_or_si128(shift, _mm_and_si128(digit, _mm_set1_epi8(52 - '0')));
+		shift = _mm_or_si128(shift, _mm_and_si128(dash, _mm_set1_epi8(62 - '-')));
+		shift = _mm_or_si128(shift, _mm_and_si128(underscore, _mm_set1_epi8(63 - '_')));
+		auto values = _mm_add_epi8(in, shift);
+
+		// join four 6 bit values into 24 bits, then pack them big endian
+		auto merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+		merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+		_mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(merged, shuffle));
+	}
+	done += i;
+	return true;
+}
+
+// writes 28 bytes, 24 are valid
+static bool DecodeAvx2(const char* text, size_t size, unsigned char* out, size_t& done)
+{
+	const auto shuffle = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+	size_t i = 0;
+	for (; size - i >= 40; i += 32, out += 24)
+	{
+		auto in = _mm256_loadu_si256((const __m256i*)(text + i));
+
+		auto upper = InRange(in, 'A', 'Z');
+		auto lower = InRange(in, 'a', 'z');
+		auto digit = InRange(in, '0', '9');
+		auto dash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('-'));
+		auto underscore = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('_'));
+
+		auto valid = _mm256_or_si256(_mm256_or_si256(upper, lower), _mm256_or_si256(_mm256_or_si256(digit, dash), underscore));
+		if ((unsigned int)_mm256_movemask_epi8(valid) != 0xffffffff)
+			return false;
+
+		auto shift = _mm256_and_si256(upper, _mm256_set1_epi8(-'A'));
+		shift = _mm256_or_si256(shift, _mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a')));
+		shift = _mm256_or_si256(shift, _mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')));
+		shift = _mm256_or_si256(shift, _mm256_and_si256(dash, _mm256_set1_epi8(62 - '-')));
+		shift = _mm256_or_si256(shift, _mm256_and_si256(underscore, _mm256_set1_epi8(63 - '_')));
+		auto values = _mm256_add_epi8(in, shift);
+
+		auto merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+		merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+		merged = _mm256_shuffle_epi8(merged, shuffle);
+
+		// lanes hold 12 bytes each, second lane overwrites padding of the first one
+		_mm_storeu_si128((__m128i*)out, _mm256_castsi256_si128(merged));
+		_mm_storeu_si128((__m128i*)(out + 12), _mm256_extracti128_si256(merged, 1));
+	}
+	done += i;
+	return DecodeSsse3(text + i, size - i, out, done);
+}
+
+using DecodeFn = bool(*)(const char*, size_t, unsigned char*, size_t&);
+
+static DecodeFn SelectDecode()
+{
+	if (Cpu::HasAvx2())
+		return DecodeAvx2;
+	if (Cpu::HasSsse3())
+		return DecodeSsse3;
+	return nullptr;
+}
+
+size_t Base64::DecodedSize(const std::string_view& text)
+{
+	auto size = text.size();
+	if (size == 0 || size % 4 != 0)
+		return 0;
+
+	return size / 4 * 3 - (text[size - 1] == '=') - (text[size - 2] == '=');
+}
+
+bool Base64::Decode(const std::string_view& text, unsigned char* out)
+{
+	static const auto simd = SelectDecode();
+
+	auto size = text.size();
+	if (size == 0 || size % 4 != 0)
+		return false;
+
+	auto* str = (const unsigned char*)text.data();
+	// last quartet may hold padding, so it is always decoded here
+	auto body = size - 4;
+
+	size_t i = 0;
+	if (simd)
+	{
+		if (!simd(text.data(), body, out, i))
+			return false;
+		out += i / 4 * 3;
+	}
+
+	for (; i < body; i += 4, out += 3)
+	{
+		int a = DecodeTable[str[i]], b = DecodeTable[str[i + 1]];
+		int c = DecodeTable[str[i + 2]], d = DecodeTable[str[i + 3]];
+		if ((a | b | c | d) < 0)
+			return false;
+
+		unsigned int v = (a << 18) | (b << 12) | (c << 6) | d;
+		out[0] = (unsigned char)(v >> 16);
+		out[1] = (unsigned char)(v >> 8);
+		out[2] = (unsigned char)v;
+	}
+
+	int a = DecodeTable[str[i]], b = DecodeTable[str[i + 1]];
+	if ((a | b) < 0)
+		return false;
+	out[0] = (unsigned char)((a << 2) | (b >> 4));
+
+	// unused bits have to be zero, same as sodium does
+	if (str[i + 2] == '=')
+		return str[i + 3] == '=' && (b & 0x0f) == 0;
+
+	int c = DecodeTable[str[i + 2]];
+	if (c < 0)
+		return false;
+	out[1] = (unsigned char)((b << 4) | (c >> 2));
+
+	if (str[i + 3] == '=')
+		return (c & 0x03) == 0;
+
+	int d = DecodeTable[str[i + 3]];
+	if (d < 0)
+		return false;
+	out[2] = (unsigned char)((c << 6) | d);
+	return true;
+}
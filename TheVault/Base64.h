@@ -0,0 +1,11 @@
+#pragma once
+#include <string>
+
+namespace Base64
+{
+	// url safe alphabet with padding, same as sodium_base64_VARIANT_URLSAFE
+	size_t DecodedSize(const std::string_view& text);
+
+	// out has to hold DecodedSize bytes
+	bool Decode(const std::string_view& text, unsigned char* out);
+};
@@ -9,7 +9,7 @@
 #include "Game.h"
 #include "Engine/Components/CameraComponent.h"
 
-Game::Game() : passMgr(unsavedState)
+Game::Game()
 {
 }
 
@@ -23,10 +23,15 @@ void Game::OnRegisterComponents(PrefabFactory& factory)
 
 bool Game::OnClose()
 {
-	if (unsavedState.HasChanged())
+	for (size_t i = 0; i < session.GetCount(); ++i)
 	{
-		mainWnd.OpenConfirmExitModal();
-		return false;
+		auto& instance = session.GetInstance(i);
+		if (instance.unsavedState.HasChanged())
+		{
+			session.SetActive(i);
+			instance.window.OpenConfirmExitModal();
+			return false;
+		}
 	}
 	return true;
 }
@@ -39,12 +44,10 @@ bool Game::OnInitialize()
 	actor->AddComponent<CameraComponent>();
 	gui = actor->AddComponent<GUIManager>();
 
-	if (!gui->Initialize() || !vault.Initialize())
+	if (!gui->Initialize() || !session.Initialize())
 		return false;
 
-	gui->RegisterObject(&mainWnd);
-	mainWnd.Initialize();
-	keeper.Init();
+	gui->RegisterObject(&session);
 	
 	//MORE LOGS!
 	//handle all errornous cases properly (so app doesn't deadlock)
@@ -65,7 +68,7 @@ Game game;
 
 bool Game::OnShutdown()
 {
-	keeper.Shutdown();
+	session.Shutdown();
 	gui->Shutdown();
 	return true;
 }
@@ -0,0 +1,57 @@
+#include <intrin.h>
+#include "Cpu.h"
+
+struct Features
+{
+	bool ssse3;
+	bool avx2;
+	bool avx512;
+};
+
+static Features Detect()
+{
+	Features features{};
+
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+
+	__cpuid(info, 1);
+	features.ssse3 = (info[2] & (1 << 9)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+
+	// xmm and ymm state has to be enabled by os
+	bool ymmState = osxsave && avx && (_xgetbv(0) & 0x6) == 0x6;
+	if (maxLeaf >= 7 && ymmState)
+	{
+		__cpuidex(info, 7, 0);
+		features.avx2 = (info[1] & (1 << 5)) != 0;
+
+		// opmask and both halves of zmm state too
+		bool zmmState = (_xgetbv(0) & 0xe6) == 0xe6;
+		features.avx512 = zmmState && (info[1] & (1 << 16)) != 0;
+	}
+	return features;
+}
+
+static const Features& Get()
+{
+	static const Features features = Detect();
+	return features;
+}
+
+bool Cpu::HasSsse3()
+{
+	return Get().ssse3;
+}
+
+bool Cpu::HasAvx2()
+{
+	return Get().avx2;
+}
+
+bool Cpu::HasAvx512()
+{
+	return Get().avx512;
+}
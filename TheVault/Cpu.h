@@ -0,0 +1,9 @@
+#pragma once
+
+namespace Cpu
+{
+	// features are detected once, os support for wider registers is checked too
+	bool HasSsse3();
+	bool HasAvx2();
+	bool HasAvx512();
+};
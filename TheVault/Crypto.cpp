@@ -1,17 +1,133 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <execution>
+#include <numeric>
+#include <thread>
+#include <vector>
 #include <sodium.h>
 #include "Crypto.h"
+#include "Argon2.h"
+#include "Base64.h"
+#include "SecureArena.h"
 
 const size_t Crypto::PwMinSize = crypto_pwhash_BYTES_MIN;
 const size_t Crypto::PwMaxSize = crypto_pwhash_BYTES_MAX;
 const size_t Crypto::PwSaltSize = crypto_pwhash_SALTBYTES;
 const size_t Crypto::ChestKeySize = crypto_secretbox_KEYBYTES;
 const size_t Crypto::ChestNonceSize = crypto_secretbox_NONCEBYTES;
+const size_t Crypto::StreamChunkSize = 64 * 1024;
+
+// costs of vaults without stored kdf parameters
+#if _DEBUG
+constexpr uint64_t OpsLimit = crypto_pwhash_OPSLIMIT_INTERACTIVE;
+constexpr size_t MemLimit = crypto_pwhash_MEMLIMIT_INTERACTIVE;
+#else
+constexpr uint64_t OpsLimit = crypto_pwhash_OPSLIMIT_SENSITIVE;
+constexpr size_t MemLimit = crypto_pwhash_MEMLIMIT_SENSITIVE;
+#endif
+
+// bounds work a tampered header can ask for
+constexpr uint32_t MaxKdfLanes = 8;
+constexpr uint32_t MaxKdfPasses = 64;
+constexpr uint32_t MaxKdfMemory = 4 * 1024 * 1024; // KiB
 
 bool Crypto::Init()
 {
 	return sodium_init() >= 0;
 }
 
+unsigned int Crypto::DefaultKdfLanes()
+{
+	auto cores = std::thread::hardware_concurrency();
+	return std::clamp(cores, 1u, MaxKdfLanes);
+}
+
+Crypto::KdfParams Crypto::DefaultKdfParams()
+{
+	return { (uint32_t)OpsLimit, (uint32_t)(MemLimit / 1024), DefaultKdfLanes() };
+}
+
+uint32_t Crypto::MinKdfMemory(unsigned int lanes)
+{
+	// argon2 needs at least two blocks per lane in each of four segments
+	return std::max<uint32_t>(crypto_pwhash_MEMLIMIT_MIN / 1024, 8 * lanes);
+}
+
+bool Crypto::IsCipherAvailable(Cipher cipher)
+{
+	switch (cipher)
+	{
+		case Cipher::SecretBox:
+		case Cipher::XChaCha20Poly1305:
+			return true;
+		case Cipher::Aes256Gcm:
+			return crypto_aead_aes256gcm_is_available() != 0;
+	}
+	return false;
+}
+
+static size_t NonceSize(Crypto::Cipher cipher)
+{
+	switch (cipher)
+	{
+		case Crypto::Cipher::XChaCha20Poly1305:
+			return crypto_aead_xchacha20poly1305_ietf_NPUBBYTES;
+		case Crypto::Cipher::Aes256Gcm:
+			return crypto_aead_aes256gcm_NPUBBYTES;
+		default:
+			return crypto_secretbox_NONCEBYTES;
+	}
+}
+
+static size_t MacSize(Crypto::Cipher cipher)
+{
+	switch (cipher)
+	{
+		case Crypto::Cipher::XChaCha20Poly1305:
+			return crypto_aead_xchacha20poly1305_ietf_ABYTES;
+		case Crypto::Cipher::Aes256Gcm:
+			return crypto_aead_aes256gcm_ABYTES;
+		default:
+			return crypto_secretbox_MACBYTES;
+	}
+}
+
+size_t Crypto::GetRecordOverhead(Cipher cipher)
+{
+	return NonceSize(cipher) + MacSize(cipher);
+}
+
+// out holds size + MacSize bytes
+static bool Seal(Crypto::Cipher cipher, unsigned char* out, const unsigned char* in, size_t size, const std::string_view& ad, const unsigned char* nonce, const unsigned char* key)
+{
+	auto* adData = (const unsigned char*)ad.data();
+	switch (cipher)
+	{
+		case Crypto::Cipher::XChaCha20Poly1305:
+			return crypto_aead_xchacha20poly1305_ietf_encrypt(out, nullptr, in, size, adData, ad.size(), nullptr, nonce, key) == 0;
+		case Crypto::Cipher::Aes256Gcm:
+			return crypto_aead_aes256gcm_encrypt(out, nullptr, in, size, adData, ad.size(), nullptr, nonce, key) == 0;
+		default:
+			return false;
+	}
+}
+
+// size includes mac, out holds size - MacSize bytes
+static bool Unseal(Crypto::Cipher cipher, unsigned char* out, const unsigned char* in, size_t size, const std::string_view& ad, const unsigned char* nonce, const unsigned char* key)
+{
+	auto* adData = (const unsigned char*)ad.data();
+	switch (cipher)
+	{
+		case Crypto::Cipher::XChaCha20Poly1305:
+			return crypto_aead_xchacha20poly1305_ietf_decrypt(out, nullptr, nullptr, in, size, adData, ad.size(), nonce, key) == 0;
+		case Crypto::Cipher::Aes256Gcm:
+			return crypto_aead_aes256gcm_decrypt(out, nullptr, nullptr, in, size, adData, ad.size(), nonce, key) == 0;
+		default:
+			return false;
+	}
+}
+
 static void FreeMemory(void* ptr)
 {
 	sodium_free(ptr);
@@ -19,56 +135,116 @@ static void FreeMemory(void* ptr)
 
 SecureArray Crypto::AllocMemory(size_t size)
 {
+	// keys, salts and passwords are small, a mapping with guard pages for each is wasteful
+	if (size <= SecureArena::MaxSize)
+	{
+		char* mem = (char*)SecureArena::Alloc(size);
+		if (!mem)
+			return nullptr;
+		return SecureArray::Wrap(mem, size, SecureArena::Free);
+	}
+
 	char* mem = (char*)sodium_malloc(size);
 	if (!mem)
 		return nullptr;
 	return SecureArray::Wrap(mem, size, FreeMemory);
 }
 
-void Crypto::ZeroMemory(SecureArray& memory)
+void Crypto::ZeroMemory(MutableSecureSpan memory)
 {
 	sodium_memzero(memory, memory.size());
 }
 
-void Crypto::FillRandomBytes(SecureArray& memory)
+void Crypto::FillRandomBytes(MutableSecureSpan memory)
 {
 	randombytes_buf(memory, memory.size());
 }
 
-SecureArray Crypto::CopyMemory(const SecureArray& memory)
+uint64_t Crypto::RandomNumber()
 {
-	auto size = memory.size();
-	char* mem = (char*)sodium_malloc(size);
-	if (!mem)
+	uint64_t value;
+	randombytes_buf(&value, sizeof(value));
+	return value;
+}
+
+SecureArray Crypto::CopyMemory(SecureSpan memory)
+{
+	auto copy = AllocMemory(memory.size());
+	if (!copy)
 		return nullptr;
-	memcpy(mem, memory, size);
-	return SecureArray::Wrap(mem, size, FreeMemory);
+	memcpy(copy, memory, memory.size());
+	return copy;
 }
 
-SecureArray Crypto::HashPassword(const std::string_view& password, const SecureArray& salt)
+bool Crypto::IsKdfParamsValid(const KdfParams& params)
+{
+	if (params.lanes == 0 || params.lanes > MaxKdfLanes || params.passes < crypto_pwhash_OPSLIMIT_MIN || params.passes > MaxKdfPasses)
+		return false;
+	return params.memory >= MinKdfMemory(params.lanes) && params.memory <= MaxKdfMemory;
+}
+
+SecureArray Crypto::HashPassword(const std::string_view& password, SecureSpan salt, const KdfParams& params, std::stop_token stop, Argon2::Workspace* workspace)
 {
 	if (password.size() < crypto_pwhash_PASSWD_MIN || password.size() > crypto_pwhash_PASSWD_MAX || salt.size() != crypto_pwhash_SALTBYTES)
 		return nullptr;
 
+	if (!IsKdfParamsValid(params))
+		return nullptr;
+
 	auto hash = AllocMemory(crypto_secretbox_KEYBYTES);
 	if (!hash)
 		return nullptr;
 
-#if _DEBUG
-	constexpr uint64_t OpsLimit = crypto_pwhash_OPSLIMIT_INTERACTIVE;
-	constexpr size_t MemLimit = crypto_pwhash_MEMLIMIT_INTERACTIVE;
-#else
-	constexpr uint64_t OpsLimit = crypto_pwhash_OPSLIMIT_SENSITIVE;
-	constexpr size_t MemLimit = crypto_pwhash_MEMLIMIT_SENSITIVE;
-#endif
-
-	int result = crypto_pwhash(hash, hash.size(), password.data(), password.size(), salt, OpsLimit, MemLimit, crypto_pwhash_ALG_DEFAULT);
-	if (result < 0)
+	if (!Argon2::Hash(hash, hash.size(), password, salt, salt.size(), params.passes, params.memory, params.lanes, stop, workspace))
 		return nullptr;
-
 	return hash;
 }
 
+static double TimeKdf(const Crypto::KdfParams& params, std::stop_token stop)
+{
+	auto salt = Crypto::AllocMemory(crypto_pwhash_SALTBYTES);
+	if (!salt)
+		return -1.0;
+	Crypto::ZeroMemory(salt);
+
+	auto start = std::chrono::steady_clock::now();
+	if (!Crypto::HashPassword("calibration", salt, params, stop))
+		return -1.0;
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+Crypto::KdfParams Crypto::CalibrateKdf(std::chrono::milliseconds latency, size_t memoryBudget, unsigned int lanes, std::stop_token stop)
+{
+	KdfParams params{ (uint32_t)crypto_pwhash_OPSLIMIT_MIN, MinKdfMemory(lanes), lanes };
+	auto maxMemory = (uint32_t)std::min<size_t>(memoryBudget / 1024, MaxKdfMemory);
+	if (lanes == 0 || maxMemory <= params.memory || latency.count() <= 0)
+		return params;
+
+	constexpr uint32_t SampleMemory = 64 * 1024;
+	KdfParams sample{ 1, std::max(std::min(maxMemory, SampleMemory), params.memory), lanes };
+	auto sampleTime = TimeKdf(sample, stop);
+	if (sampleTime <= 0.0)
+		return params;
+
+	auto target = std::chrono::duration<double>(latency).count();
+	auto costPerKiB = sampleTime / sample.memory;
+
+	// memory is what makes attacks expensive, so it is filled first and passes use the remaining time
+	params.memory = (uint32_t)std::clamp(target / costPerKiB, (double)params.memory, (double)maxMemory);
+	params.passes = (uint32_t)std::clamp(target / (costPerKiB * params.memory), 1.0, (double)MaxKdfPasses);
+
+	auto time = TimeKdf(params, stop);
+	if (time > target)
+	{
+		auto scale = target / time;
+		if (params.passes > 1)
+			params.passes = std::max(1u, (uint32_t)(params.passes * scale));
+		else
+			params.memory = std::max(MinKdfMemory(lanes), (uint32_t)(params.memory * scale));
+	}
+	return params;
+}
+
 SecureArray Crypto::HashData(const std::string_view& data)
 {
 	if (data.empty())
@@ -85,7 +261,23 @@ SecureArray Crypto::HashData(const std::string_view& data)
 	return hash;
 }
 
-SecureArray Crypto::CreateChest(const std::string_view& content, const SecureArray& key, const SecureArray& nonce)
+SecureArray Crypto::DeriveKey(SecureSpan key, uint64_t id, const char* context)
+{
+	if (key.size() != crypto_kdf_KEYBYTES || !context || strlen(context) != crypto_kdf_CONTEXTBYTES)
+		return nullptr;
+
+	auto subkey = AllocMemory(crypto_secretbox_KEYBYTES);
+	if (!subkey)
+		return nullptr;
+
+	int result = crypto_kdf_derive_from_key(subkey, subkey.size(), id, context, key);
+	if (result < 0)
+		return nullptr;
+
+	return subkey;
+}
+
+SecureArray Crypto::CreateChest(const std::string_view& content, SecureSpan key, SecureSpan nonce)
 {
 	if (content.empty() || key.size() != crypto_secretbox_KEYBYTES || nonce.size() != crypto_secretbox_NONCEBYTES)
 		return nullptr;
@@ -101,7 +293,7 @@ SecureArray Crypto::CreateChest(const std::string_view& content, const SecureArr
 	return chest;
 }
 
-SecureArray Crypto::OpenChest(const SecureArray& chest, const SecureArray& key, const SecureArray& nonce)
+SecureArray Crypto::OpenChest(SecureSpan chest, SecureSpan key, SecureSpan nonce)
 {
 	if (!chest || key.size() != crypto_secretbox_KEYBYTES || nonce.size() != crypto_secretbox_NONCEBYTES || chest.size() <= crypto_secretbox_MACBYTES)
 		return nullptr;
@@ -117,7 +309,7 @@ SecureArray Crypto::OpenChest(const SecureArray& chest, const SecureArray& key,
 	return content;
 }
 
-bool Crypto::OpenChestInPlace(SecureArray& chest, const SecureArray& key, const SecureArray& nonce)
+bool Crypto::OpenChestInPlace(MutableSecureSpan chest, SecureSpan key, SecureSpan nonce)
 {
 	if (!chest || key.size() != crypto_secretbox_KEYBYTES || nonce.size() != crypto_secretbox_NONCEBYTES || chest.size() <= crypto_secretbox_MACBYTES)
 		return false;
@@ -129,26 +321,164 @@ bool Crypto::OpenChestInPlace(SecureArray& chest, const SecureArray& key, const
 	return true;
 }
 
-FixedArrayUChar Crypto::Base64ToBuffer(const std::string_view& text)
+// segment nonce is base nonce with segment index mixed into its last 8 bytes,
+// index and final flag are appended to ad, so segments can't be reordered or dropped
+static void SegmentParams(const unsigned char* base, size_t nonceSize, uint64_t i, bool final, unsigned char* nonce, std::string& ad, size_t adSize)
+{
+	memcpy(nonce, base, nonceSize);
+	for (size_t k = 0; k < sizeof(i); ++k)
+		nonce[nonceSize - sizeof(i) + k] ^= (unsigned char)(i >> (k * 8));
+
+	ad.resize(adSize);
+	ad.append((const char*)&i, sizeof(i));
+	ad.push_back(final ? 1 : 0);
+}
+
+// segments are independent, so they are sealed in batches spread over all cores
+constexpr size_t SegmentsPerTask = 16;
+
+template<typename Fn>
+static bool ForEachSegment(size_t segments, const std::string_view& ad, std::stop_token stop, Fn&& fn)
+{
+	std::vector<size_t> tasks((segments + SegmentsPerTask - 1) / SegmentsPerTask);
+	std::iota(tasks.begin(), tasks.end(), 0);
+
+	std::atomic_bool ok = true;
+	std::for_each(std::execution::par, tasks.begin(), tasks.end(), [&](size_t task)
+	{
+		unsigned char nonce[crypto_aead_xchacha20poly1305_ietf_NPUBBYTES];
+		std::string segmentAd(ad);
+
+		if (stop.stop_requested())
+			ok = false;
+
+		auto end = std::min(segments, (task + 1) * SegmentsPerTask);
+		for (size_t i = task * SegmentsPerTask; i < end && ok; ++i)
+		{
+			if (!fn(i, nonce, segmentAd))
+				ok = false;
+		}
+	});
+	return ok;
+}
+
+SecureArray Crypto::CreateSegmentedChest(const std::string_view& content, SecureSpan key, size_t chunkSize, Cipher cipher, const std::string_view& ad, std::stop_token stop)
+{
+	if (content.empty() || chunkSize == 0 || key.size() != ChestKeySize || cipher == Cipher::SecretBox || !IsCipherAvailable(cipher))
+		return nullptr;
+
+	auto nonceSize = NonceSize(cipher);
+	auto macSize = MacSize(cipher);
+	auto segments = (content.size() + chunkSize - 1) / chunkSize;
+	auto chest = AllocMemory(nonceSize + content.size() + segments * macSize);
+	if (!chest)
+		return nullptr;
+
+	randombytes_buf(chest, nonceSize);
+
+	bool sealed = ForEachSegment(segments, ad, stop, [&](size_t i, unsigned char* nonce, std::string& segmentAd)
+	{
+		auto offset = i * chunkSize;
+		auto size = std::min(content.size() - offset, chunkSize);
+		SegmentParams(chest, nonceSize, i, i + 1 == segments, nonce, segmentAd, ad.size());
+
+		auto* out = chest + nonceSize + offset + i * macSize;
+		return Seal(cipher, out, (const unsigned char*)content.data() + offset, size, segmentAd, nonce, key);
+	});
+
+	if (!sealed)
+		return nullptr;
+	return chest;
+}
+
+SecureArray Crypto::OpenSegmentedChest(SecureSpan chest, SecureSpan key, size_t chunkSize, Cipher cipher, const std::string_view& ad, std::stop_token stop)
 {
-	if (text.size() == 0 || text.size() % 4 != 0 || text.size() > INT32_MAX)
+	if (!chest || chunkSize == 0 || key.size() != ChestKeySize || cipher == Cipher::SecretBox || !IsCipherAvailable(cipher))
+		return nullptr;
+
+	auto nonceSize = NonceSize(cipher);
+	auto macSize = MacSize(cipher);
+	if (chest.size() <= nonceSize + macSize)
+		return nullptr;
+
+	auto body = chest.size() - nonceSize;
+	auto segments = (body + chunkSize + macSize - 1) / (chunkSize + macSize);
+	// last segment can't be empty
+	if (body - (segments - 1) * (chunkSize + macSize) <= macSize)
 		return nullptr;
 
-	size_t size;
-	auto buffer = FixedArrayUChar((unsigned int)text.size() / 4 * 3);
-	if (sodium_base642bin(buffer, buffer.size(), text.data(), text.size(), nullptr, &size, nullptr, sodium_base64_VARIANT_URLSAFE) == 0)
-		return FixedArrayUChar::Copy(buffer, (unsigned int)size);
-	return nullptr;
+	auto content = AllocMemory(body - segments * macSize);
+	if (!content)
+		return nullptr;
+
+	// segments are decrypted straight into their place in the final buffer
+	bool opened = ForEachSegment(segments, ad, stop, [&](size_t i, unsigned char* nonce, std::string& segmentAd)
+	{
+		auto offset = i * chunkSize;
+		auto size = std::min(content.size() - offset, chunkSize);
+		SegmentParams(chest, nonceSize, i, i + 1 == segments, nonce, segmentAd, ad.size());
+
+		auto* in = chest + nonceSize + offset + i * macSize;
+		return Unseal(cipher, content + offset, in, size + macSize, segmentAd, nonce, key);
+	});
+
+	if (!opened)
+		return nullptr;
+	return content;
 }
 
-bool Crypto::BufferToBase64(const FixedArrayUChar& buffer, std::string& text)
+bool Crypto::CreateRecord(const std::string_view& content, SecureSpan key, unsigned char* out, Cipher cipher, const std::string_view& ad)
 {
-	text.resize(sodium_base64_encoded_len(buffer.size(), sodium_base64_VARIANT_URLSAFE));
-	if (sodium_bin2base64(text.data(), text.size(), buffer, buffer.size(), sodium_base64_VARIANT_URLSAFE))
+	if (!out || key.size() != ChestKeySize || !IsCipherAvailable(cipher))
+		return false;
+
+	auto nonceSize = NonceSize(cipher);
+	randombytes_buf(out, nonceSize);
+	return Seal(cipher, out + nonceSize, (const unsigned char*)content.data(), content.size(), ad, out, key);
+}
+
+bool Crypto::OpenRecord(const unsigned char* record, size_t size, SecureSpan key, SecureArray& content, Cipher cipher, const std::string_view& ad)
+{
+	if (!record || key.size() != ChestKeySize || size < GetRecordOverhead(cipher) || !IsCipherAvailable(cipher))
+		return false;
+
+	auto nonceSize = NonceSize(cipher);
+	auto macSize = MacSize(cipher);
+	auto* nonce = record;
+	record += nonceSize;
+	size -= nonceSize;
+
+	// empty content has nothing to decrypt into, but the mac still has to match
+	if (size == macSize)
 	{
-		text.resize(text.size() - 1);
-		return true;
+		unsigned char empty;
+		content = nullptr;
+		return Unseal(cipher, &empty, record, size, ad, nonce, key);
 	}
-	text.clear();
-	return false;
+
+	auto mem = AllocMemory(size - macSize);
+	if (!mem)
+		return false;
+
+	if (!Unseal(cipher, mem, record, size, ad, nonce, key))
+		return false;
+
+	content = std::move(mem);
+	return true;
+}
+
+SecureArray Crypto::Base64ToBuffer(const std::string_view& text)
+{
+	if (text.size() == 0 || text.size() % 4 != 0)
+		return nullptr;
+
+	// decoded straight into the final buffer
+	auto size = Base64::DecodedSize(text);
+	if (size == 0)
+		return nullptr;
+
+	auto buffer = AllocMemory(size);
+	if (!buffer || !Base64::Decode(text, buffer))
+		return nullptr;
+	return buffer;
 }
@@ -1,29 +1,72 @@
 #pragma once
+#include <chrono>
+#include <stop_token>
 #include <string>
 #include "SecureArray.h"
+#include "SecureSpan.h"
 #include "Utility/FixedArray.h"
 
+namespace Argon2
+{
+	class Workspace;
+};
+
 namespace Crypto
 {
+	enum class Cipher : unsigned char
+	{
+		SecretBox, // legacy, whole block sealed as one secretbox chest
+		XChaCha20Poly1305,
+		Aes256Gcm, // needs hardware support
+	};
+
+	struct KdfParams
+	{
+		uint32_t passes;
+		uint32_t memory; // KiB
+		uint32_t lanes;
+	};
+
 	extern const size_t PwMinSize;
 	extern const size_t PwMaxSize;
 	extern const size_t PwSaltSize;
 	extern const size_t ChestKeySize;
 	extern const size_t ChestNonceSize;
+	extern const size_t StreamChunkSize;
 
 	bool Init();
+	unsigned int DefaultKdfLanes();
+	KdfParams DefaultKdfParams();
+	uint32_t MinKdfMemory(unsigned int lanes);
+	bool IsKdfParamsValid(const KdfParams& params);
+	// benchmarks this machine for the most memory and passes that fit both budgets
+	KdfParams CalibrateKdf(std::chrono::milliseconds latency, size_t memoryBudget, unsigned int lanes, std::stop_token stop = {});
+	bool IsCipherAvailable(Cipher cipher);
+	size_t GetRecordOverhead(Cipher cipher);
 	SecureArray AllocMemory(size_t size);
-	void ZeroMemory(SecureArray& memory);
-	void FillRandomBytes(SecureArray& memory);
-	SecureArray CopyMemory(const SecureArray& memory);
+	void ZeroMemory(MutableSecureSpan memory);
+	void FillRandomBytes(MutableSecureSpan memory);
+	uint64_t RandomNumber();
+	SecureArray CopyMemory(SecureSpan memory);
 
-	SecureArray HashPassword(const std::string_view& password, const SecureArray& salt);
+	// in-tree argon2id, single lane output is the same as crypto_pwhash
+	// stop interrupts hashing between slices, without workspace memory is allocated per call
+	SecureArray HashPassword(const std::string_view& password, SecureSpan salt, const KdfParams& params, std::stop_token stop = {}, Argon2::Workspace* workspace = nullptr);
 	SecureArray HashData(const std::string_view& data);
+	SecureArray DeriveKey(SecureSpan key, uint64_t id, const char* context);
+
+	SecureArray CreateChest(const std::string_view& content, SecureSpan key, SecureSpan nonce);
+	SecureArray OpenChest(SecureSpan chest, SecureSpan key, SecureSpan nonce);
+	bool OpenChestInPlace(MutableSecureSpan chest, SecureSpan key, SecureSpan nonce);
+
+	// segments are sealed with nonces derived from one random nonce, ad is bound to every segment
+	// stop is checked between groups of segments
+	SecureArray CreateSegmentedChest(const std::string_view& content, SecureSpan key, size_t chunkSize, Cipher cipher, const std::string_view& ad, std::stop_token stop = {});
+	SecureArray OpenSegmentedChest(SecureSpan chest, SecureSpan key, size_t chunkSize, Cipher cipher, const std::string_view& ad, std::stop_token stop = {});
 
-	SecureArray CreateChest(const std::string_view& content, const SecureArray& key, const SecureArray& nonce);
-	SecureArray OpenChest(const SecureArray& chest, const SecureArray& key, const SecureArray& nonce);
-	bool OpenChestInPlace(SecureArray& chest, const SecureArray& key, const SecureArray& nonce);
+	// record is random nonce followed by sealed content, out must hold content + GetRecordOverhead bytes
+	bool CreateRecord(const std::string_view& content, SecureSpan key, unsigned char* out, Cipher cipher, const std::string_view& ad);
+	bool OpenRecord(const unsigned char* record, size_t size, SecureSpan key, SecureArray& content, Cipher cipher, const std::string_view& ad);
 
-	FixedArrayUChar Base64ToBuffer(const std::string_view& text);
-	bool BufferToBase64(const FixedArrayUChar& buffer, std::string& text);
+	SecureArray Base64ToBuffer(const std::string_view& text);
 };
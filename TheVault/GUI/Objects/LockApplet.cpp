@@ -1,20 +1,24 @@
+#include <algorithm>
+#include <format>
 #include <string>
 #include "ImGuiUtils.h"
 #include "LockApplet.h"
-#include "../../Game.h"
+#include "../../VaultSession.h"
 #include "../../WinApi.h"
 #include "../../Crypto.h"
 #include "../../StringUtils.h"
 
-extern Game game;
-
-LockApplet::LockApplet()
+LockApplet::LockApplet(VaultInstance& instance) : instance(instance)
 {
 	openSetHintValueModal = false;
 	openChangeHintModal = false;
 	openDeleteModal = false;
 	openResetSalts = false;
+	openCalibrate = false;
+	closeTaskModal = false;
 	modalIdx = 0;
+	kdfLatency = 1000;
+	kdfMemory = 1024;
 
 	nameInput.reserve(256);
 }
@@ -28,7 +32,7 @@ void LockApplet::Initialize()
 	passwordInput = Crypto::AllocMemory(256);
 	if (!passwordInput)
 	{
-		game.GetKeeper().RaiseError("Failed to allocate memory", true);
+		instance.keeper.RaiseError("Failed to allocate memory", true);
 		return;
 	}
 	Crypto::ZeroMemory(passwordInput);
@@ -62,6 +66,19 @@ void LockApplet::OpenResetSaltsModal()
 	openResetSalts = true;
 }
 
+void LockApplet::OpenCalibrateModal()
+{
+	openCalibrate = true;
+}
+
+UiTask<> LockApplet::AwaitTask()
+{
+	auto& window = instance.window;
+	auto result = co_await vaultTask;
+	closeTaskModal = true;
+	window.ApplyResult(result);
+}
+
 void LockApplet::Render()
 {
 	RenderMain();
@@ -69,6 +86,7 @@ void LockApplet::Render()
 	RenderChangeHintModal();
 	RenderDeleteModal();
 	RenderResetSaltsModal();
+	RenderCalibrateModal();
 }
 
 void LockApplet::RenderMain()
@@ -78,21 +96,40 @@ void LockApplet::RenderMain()
 	if (ImGui::BeginMenuBar())
 	{
 		if (ImGui::MenuItem("Passwords"))
-			game.GetMainWindow().SwitchToMainView();
+			instance.window.SwitchToMainView();
 		if (ImGui::MenuItem("Save"))
-			game.GetMainWindow().SaveVault();
+			instance.window.SaveVault();
+		if (ImGui::MenuItem("Compact"))
+			instance.window.CompactVault();
 		if (ImGui::MenuItem("Close"))
 		{
-			if (game.GetUnsavedState().HasChanged())
-				game.GetMainWindow().OpenConfirmExitModal();
+			if (instance.unsavedState.HasChanged())
+				instance.window.OpenConfirmExitModal();
 			else
-				game.GetMainWindow().CloseVault();
+				instance.window.CloseVault();
 		}
 		ImGui::EndMenuBar();
 	}
 
 	if (ImGui::Button("Reset public tokens"))
 		OpenResetSaltsModal();
+	ImGui::SameLine();
+	bool records = instance.keeper.IsRecordLayout();
+	if (ImGui::Checkbox("Encrypt passwords separately", &records))
+		instance.keeper.SetRecordLayout(records);
+	if (Crypto::IsCipherAvailable(Crypto::Cipher::Aes256Gcm))
+	{
+		ImGui::SameLine();
+		bool aes = instance.keeper.IsAesCipher();
+		if (ImGui::Checkbox("Use AES-256-GCM", &aes))
+			instance.keeper.SetAesCipher(aes);
+	}
+
+	if (ImGui::Button("Calibrate unlock time"))
+		OpenCalibrateModal();
+	ImGui::SameLine();
+	auto kdf = instance.keeper.GetKdfParams();
+	Text(std::format("Key derivation: {} passes, {} MiB, {} lanes", kdf.passes, kdf.memory / 1024, kdf.lanes));
 	ImGui::Separator();
 
 	Text("Vault Locks");
@@ -106,7 +143,7 @@ void LockApplet::RenderMain()
 	bool submit = ImGui::InputText("##HintNameInput", nameInput.data(), nameInput.capacity() - 1, ImGuiInputTextFlags_EnterReturnsTrue);
 	if (submit || submit2)
 	{
-		game.GetKeeper().AddHint(nameInput.data());
+		instance.keeper.AddHint(nameInput.data());
 		nameInput.clear();
 	}
 
@@ -120,7 +157,7 @@ void LockApplet::RenderMain()
 		ImGui::TableSetupColumn("");
 		ImGui::TableHeadersRow();
 
-		auto& keeper = game.GetKeeper();
+		auto& keeper = instance.keeper;
 		keeper.LockDirectApi();
 
 		int hintCount = keeper.GetHintCount();
@@ -182,7 +219,13 @@ void LockApplet::RenderSetHintValueModal()
 
 	if (ImGui::BeginPopupModal("Hint Value", nullptr, ImGuiWindowFlags_AlwaysAutoResize))
 	{
-		auto& keeper = game.GetKeeper();
+		if (closeTaskModal)
+		{
+			closeTaskModal = false;
+			ImGui::CloseCurrentPopup();
+		}
+
+		auto& keeper = instance.keeper;
 
 		keeper.LockDirectApi();
 		Text(keeper.GetHint(modalIdx));
@@ -205,13 +248,16 @@ void LockApplet::RenderSetHintValueModal()
 			{
 				vaultTask = keeper.SetHintKey(modalIdx, passwordInput);
 				Crypto::ZeroMemory(passwordInput);
+				AwaitTask();
 			}
 		}
 		else
 		{
-			ImGui::ProgressBar(-1.0f * (float)ImGui::GetTime(), ImVec2(-FLT_MIN, 0), "Hashing...");
-			if (game.GetMainWindow().ProcessVaultResponse(vaultTask) != MainWindow::_TR_NoAction)
-				ImGui::CloseCurrentPopup();
+			auto queued = instance.keeper.GetKdfQueuePosition();
+			auto label = queued != 0 ? std::format("Waiting for memory (queue position {})", queued) : std::string("Hashing...");
+			ImGui::ProgressBar(-1.0f * (float)ImGui::GetTime(), ImVec2(-FLT_MIN, 0), label.c_str());
+			if (ImGui::Button("Cancel"))
+				vaultTask.Cancel();
 		}
 
 		ImGui::EndPopup();
@@ -225,7 +271,7 @@ void LockApplet::RenderChangeHintModal()
 		openChangeHintModal = false;
 		ImGui::OpenPopup("Change hint");
 
-		nameInput = game.GetKeeper().GetHint(modalIdx);
+		nameInput = instance.keeper.GetHint(modalIdx);
 	}
 
 	if (ImGui::BeginPopupModal("Change hint", nullptr, ImGuiWindowFlags_AlwaysAutoResize))
@@ -235,7 +281,7 @@ void LockApplet::RenderChangeHintModal()
 		if (ImGui::Button("Set"))
 		{
 			auto name = std::string_view(nameInput.data());
-			game.GetKeeper().ChangeHint(modalIdx, name);
+			instance.keeper.ChangeHint(modalIdx, name);
 			nameInput.clear();
 			ImGui::CloseCurrentPopup();
 		}
@@ -264,7 +310,7 @@ void LockApplet::RenderDeleteModal()
 		Text("Name: ");
 		ImGui::SameLine();
 
-		auto& keeper = game.GetKeeper();
+		auto& keeper = instance.keeper;
 		keeper.LockDirectApi();
 
 		Text(keeper.GetHint(modalIdx));
@@ -296,7 +342,7 @@ void LockApplet::RenderResetSaltsModal()
 
 		if (ImGui::Button("Reset"))
 		{
-			game.GetKeeper().ResetSalts();
+			instance.keeper.ResetSalts();
 			ImGui::CloseCurrentPopup();
 		}
 		ImGui::SameLine();
@@ -306,3 +352,51 @@ void LockApplet::RenderResetSaltsModal()
 		ImGui::EndPopup();
 	}
 }
+
+void LockApplet::RenderCalibrateModal()
+{
+	if (openCalibrate)
+	{
+		openCalibrate = false;
+		ImGui::OpenPopup("Calibrate Unlock Time");
+	}
+
+	if (ImGui::BeginPopupModal("Calibrate Unlock Time", nullptr, ImGuiWindowFlags_AlwaysAutoResize))
+	{
+		if (closeTaskModal)
+		{
+			closeTaskModal = false;
+			ImGui::CloseCurrentPopup();
+		}
+
+		if (!vaultTask.valid())
+		{
+			Text("Measures this machine and picks the hardest key derivation within the limits.");
+			Text("Every hint value has to be set again afterwards.");
+
+			ImGui::InputInt("Time per hint (ms)", &kdfLatency, 100, 1000);
+			ImGui::InputInt("Memory (MiB)", &kdfMemory, 64, 256);
+			kdfLatency = std::clamp(kdfLatency, 100, 60000);
+			kdfMemory = std::clamp(kdfMemory, 1, 64 * 1024);
+
+			if (ImGui::Button("Calibrate"))
+			{
+				vaultTask = instance.keeper.CalibrateKdf(std::chrono::milliseconds(kdfLatency), (size_t)kdfMemory * 1024 * 1024);
+				AwaitTask();
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Cancel"))
+				ImGui::CloseCurrentPopup();
+		}
+		else
+		{
+			auto queued = instance.keeper.GetKdfQueuePosition();
+			auto label = queued != 0 ? std::format("Waiting for memory (queue position {})", queued) : std::string("Calibrating...");
+			ImGui::ProgressBar(-1.0f * (float)ImGui::GetTime(), ImVec2(-FLT_MIN, 0), label.c_str());
+			if (ImGui::Button("Cancel"))
+				vaultTask.Cancel();
+		}
+
+		ImGui::EndPopup();
+	}
+}
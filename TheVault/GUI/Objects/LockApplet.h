@@ -1,34 +1,46 @@
 #pragma once
-#include <future>
+#include "../../VaultKeeper.h"
 #include "../../SecureArray.h"
+#include "../../UiTask.h"
 #include "IApplet.h"
 
+class VaultInstance;
+
 class LockApplet : public IApplet
 {
 private:
+	VaultInstance& instance;
+
 	bool openSetHintValueModal : 1;
 	bool openChangeHintModal : 1;
 	bool openDeleteModal : 1;
 	bool openResetSalts : 1;
+	bool openCalibrate : 1;
+	bool closeTaskModal : 1; // task of the open modal is done
 	int modalIdx;
+	int kdfLatency; // ms
+	int kdfMemory; // MiB
 
 	std::string nameInput;
 	SecureArray passwordInput;
-	std::future<uint64_t> vaultTask;
+	VaultKeeper::Future vaultTask;
 
 	void OpenSetHintValueModal(int idx);
 	void OpenChangeHintModal(int idx);
 	void OpenDeleteModal(int idx);
 	void OpenResetSaltsModal();
+	void OpenCalibrateModal();
+	UiTask<> AwaitTask();
 	
 	void RenderMain();
 	void RenderSetHintValueModal();
 	void RenderChangeHintModal();
 	void RenderDeleteModal();
 	void RenderResetSaltsModal();
+	void RenderCalibrateModal();
 
 public:
-	LockApplet();
+	LockApplet(VaultInstance& instance);
 	~LockApplet();
 
 	void Initialize();
@@ -1,13 +1,14 @@
+#include <algorithm>
+#include <format>
 #include "ImGuiUtils.h"
 #include "LoginApplet.h"
-#include "../../Game.h"
+#include "../../VaultSession.h"
 #include "../../Crypto.h"
 
-extern Game game;
-
-LoginApplet::LoginApplet()
+LoginApplet::LoginApplet(VaultInstance& instance) : instance(instance)
 {
 	hint.reserve(256);
+	batchMode = false;
 }
 
 LoginApplet::~LoginApplet()
@@ -19,7 +20,7 @@ void LoginApplet::Initialize()
 	passwordInput = Crypto::AllocMemory(256);
 	if (!passwordInput)
 	{
-		game.GetKeeper().RaiseError("Failed to allocate memory", true);
+		instance.keeper.RaiseError("Failed to allocate memory", true);
 		return;
 	}
 	Crypto::ZeroMemory(passwordInput);
@@ -28,6 +29,15 @@ void LoginApplet::Initialize()
 void LoginApplet::OnLeave()
 {
 	hint.clear();
+	ClearBatch();
+}
+
+void LoginApplet::ClearBatch()
+{
+	for (auto& input : batchInputs)
+	{
+		Crypto::ZeroMemory(input);
+	}
 }
 
 void LoginApplet::Render()
@@ -40,31 +50,97 @@ void LoginApplet::Render()
 
 	if (!vaultTask.valid())
 	{
-		ImGui::BeginGroup();
+		ImGui::Checkbox("Enter all passwords at once", &batchMode);
+		if (batchMode)
+			RenderBatch();
+		else
+			RenderSingle();
+	}
+	else
+	{
+		auto queued = instance.keeper.GetKdfQueuePosition();
+		auto label = queued != 0 ? std::format("Waiting for memory (queue position {})", queued) : std::string("Decrypting...");
+		ImGui::ProgressBar(-1.0f * (float)ImGui::GetTime(), ImVec2(-FLT_MIN, 0), label.c_str());
+		if (ImGui::Button("Cancel"))
+			vaultTask.Cancel();
+	}
 
-		SetNextRightButtonAlign("Submit");
-		constexpr auto flags = ImGuiInputTextFlags_AllowTabInput | ImGuiInputTextFlags_EnterReturnsTrue | ImGuiInputTextFlags_Password | ImGuiInputTextFlags_NoUndoRedo;
-		bool submit = ImGui::InputText("##Password", passwordInput.str(), passwordInput.size(), flags);
-		ImGui::SameLine();
-		bool submit2 = ImGui::Button("Submit");
-		if (submit || submit2)
+	ImGui::EndChild();
+}
+
+void LoginApplet::RenderSingle()
+{
+	ImGui::BeginGroup();
+
+	SetNextRightButtonAlign("Submit");
+	constexpr auto flags = ImGuiInputTextFlags_AllowTabInput | ImGuiInputTextFlags_EnterReturnsTrue | ImGuiInputTextFlags_Password | ImGuiInputTextFlags_NoUndoRedo;
+	bool submit = ImGui::InputText("##Password", passwordInput.str(), passwordInput.size(), flags);
+	ImGui::SameLine();
+	bool submit2 = ImGui::Button("Submit");
+	if (submit || submit2)
+	{
+		vaultTask = instance.keeper.SubmitPassword(passwordInput);
+		Crypto::ZeroMemory(passwordInput);
+		AwaitUnlock();
+	}
+
+	ImGui::EndGroup();
+}
+
+void LoginApplet::RenderBatch()
+{
+	// first field answers the shown hint, the rest follow the chain in order
+	auto count = (size_t)std::max(instance.keeper.GetPendingSteps(), 0);
+	while (batchInputs.size() < count)
+	{
+		auto input = Crypto::AllocMemory(256);
+		if (!input)
 		{
-			vaultTask = game.GetKeeper().SubmitPassword(passwordInput);
-			Crypto::ZeroMemory(passwordInput);
+			instance.keeper.RaiseError("Failed to allocate memory", true);
+			return;
 		}
+		Crypto::ZeroMemory(input);
+		batchInputs.push_back(std::move(input));
+	}
 
-		ImGui::EndGroup();
+	ImGui::BeginGroup();
+
+	bool submit = false;
+	constexpr auto flags = ImGuiInputTextFlags_EnterReturnsTrue | ImGuiInputTextFlags_Password | ImGuiInputTextFlags_NoUndoRedo;
+	for (size_t i = 0; i < count; ++i)
+	{
+		ImGui::PushID((int)i);
+		Text(std::format("{}.", i + 1));
+		ImGui::SameLine();
+		ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+		submit |= ImGui::InputText("##Password", batchInputs[i].str(), batchInputs[i].size(), flags);
+		ImGui::PopID();
 	}
-	else
+
+	submit |= ImGui::Button("Submit");
+	if (submit && count > 0)
 	{
-		ImGui::ProgressBar(-1.0f * (float)ImGui::GetTime(), ImVec2(-FLT_MIN, 0), "Decrypting...");
-		game.GetMainWindow().ProcessVaultResponse(vaultTask);
+		batchInputs.resize(count);
+		vaultTask = instance.keeper.SubmitPasswords(batchInputs);
+		ClearBatch();
+		AwaitUnlock();
 	}
 
-	ImGui::EndChild();
+	ImGui::EndGroup();
+}
+
+UiTask<> LoginApplet::AwaitUnlock()
+{
+	auto& window = instance.window;
+	auto result = co_await vaultTask;
+
+	// batch may stop at a wrong password after unlocking some hints
+	if (result.error == KeeperError::Failed)
+		RefreshHintName();
+	window.ApplyResult(result);
 }
 
 void LoginApplet::RefreshHintName()
 {
-	game.GetKeeper().GetLastHint(hint);
+	instance.keeper.GetLastHint(hint);
 }
@@ -1,18 +1,30 @@
 #pragma once
 #include <string>
-#include <future>
+#include <vector>
+#include "../../VaultKeeper.h"
 #include "../../SecureArray.h"
+#include "../../UiTask.h"
 #include "IApplet.h"
 
+class VaultInstance;
+
 class LoginApplet : public IApplet
 {
 private:
+	VaultInstance& instance;
 	SecureArray passwordInput;
+	std::vector<SecureArray> batchInputs; // one per remaining hint in batch mode
 	std::string hint;
-	std::future<uint64_t> vaultTask;
+	VaultKeeper::Future vaultTask;
+	bool batchMode;
+
+	void RenderSingle();
+	void RenderBatch();
+	void ClearBatch();
+	UiTask<> AwaitUnlock();
 
 public:
-	LoginApplet();
+	LoginApplet(VaultInstance& instance);
 	~LoginApplet();
 
 	void Initialize();
@@ -2,13 +2,11 @@
 #include "ImGuiUtils.h"
 #include "Utility/StringUtils.h"
 #include "MainApplet.h"
-#include "../../Game.h"
+#include "../../VaultSession.h"
 #include "../../WinApi.h"
 #include "../../StringUtils.h"
 
-extern Game game;
-
-MainApplet::MainApplet()
+MainApplet::MainApplet(VaultInstance& instance) : instance(instance)
 {
 	openSelectAddModal = false;
 	openAddTextModal = false;
@@ -101,16 +99,18 @@ void MainApplet::RenderMain()
 
 	if (ImGui::BeginMenuBar())
 	{
-		if (ImGui::MenuItem("Settings"))
-			game.GetMainWindow().SwitchToLockSetup();
-		if (ImGui::MenuItem("Save"))
-			game.GetMainWindow().SaveVault();
-		if (ImGui::MenuItem("Close"))
+		// entries can be edited during a save, vault settings and closing wait for it
+		bool saving = instance.window.IsSaving();
+		if (ImGui::MenuItem("Settings", nullptr, false, !saving))
+			instance.window.SwitchToLockSetup();
+		if (ImGui::MenuItem(saving ? "Saving...###Save" : "Save", nullptr, false, !saving))
+			instance.window.SaveVaultInBackground();
+		if (ImGui::MenuItem("Close", nullptr, false, !saving))
 		{
-			if (game.GetUnsavedState().HasChanged())
-				game.GetMainWindow().OpenConfirmExitModal();
+			if (instance.unsavedState.HasChanged())
+				instance.window.OpenConfirmExitModal();
 			else
-				game.GetMainWindow().CloseVault();
+				instance.window.CloseVault();
 		}
 		ImGui::EndMenuBar();
 	}
@@ -123,7 +123,7 @@ void MainApplet::RenderMain()
 		ImGui::TableSetupColumn("Password");
 		ImGui::TableHeadersRow();
 
-		auto& passMgr = game.GetPassManager();
+		auto& passMgr = instance.passMgr;
 		int hintCount = passMgr.GetCount();
 		for (int i = 0; i < hintCount; ++i)
 		{
@@ -233,7 +233,7 @@ void MainApplet::RenderAddTextModal()
 		{
 			auto name = std::string_view(nameInput.data());
 			auto pwd = std::string_view(pwdInput.data());
-			game.GetPassManager().Add(name, pwd);
+			instance.passMgr.Add(name, pwd);
 			memset(pwdInput.data(), 0, pwdInput.capacity());
 			nameInput.clear();
 			ImGui::CloseCurrentPopup();
@@ -274,7 +274,7 @@ void MainApplet::RenderAddFileModal()
 			if (!wBuffer.empty())
 			{
 				auto name = std::string_view(nameInput.data());
-				game.GetPassManager().AddFile(name, wBuffer);
+				instance.passMgr.AddFile(name, wBuffer);
 				wBuffer.clear();
 				nameInput.clear();
 				ImGui::CloseCurrentPopup();
@@ -326,7 +326,7 @@ void MainApplet::RenderShowTextModal()
 
 	if (ImGui::BeginPopupModal("Password details", nullptr, ImGuiWindowFlags_AlwaysAutoResize))
 	{
-		auto& passMgr = game.GetPassManager();
+		auto& passMgr = instance.passMgr;
 		auto pwd = passMgr.GetPassword(modalIdx);
 		Text(passMgr.GetName(modalIdx));
 		Text(pwd);
@@ -359,7 +359,7 @@ void MainApplet::RenderChangeTextModal()
 
 	if (ImGui::BeginPopupModal("Change password - TEXT", nullptr, ImGuiWindowFlags_AlwaysAutoResize))
 	{
-		auto& passMgr = game.GetPassManager();
+		auto& passMgr = instance.passMgr;
 		Text(passMgr.GetName(modalIdx));
 
 		constexpr auto flags = ImGuiInputTextFlags_AllowTabInput | ImGuiInputTextFlags_EnterReturnsTrue | ImGuiInputTextFlags_Password | ImGuiInputTextFlags_NoUndoRedo;
@@ -402,7 +402,7 @@ void MainApplet::RenderChangeFileModal()
 	{
 		static std::wstring file;
 
-		auto& passMgr = game.GetPassManager();
+		auto& passMgr = instance.passMgr;
 		auto name = passMgr.GetName(modalIdx);
 		Text(name);
 
@@ -447,7 +447,7 @@ void MainApplet::RenderChangeNameModal()
 		openChangeNameModal = false;
 		ImGui::OpenPopup("Change password name");
 
-		nameInput = game.GetPassManager().GetName(modalIdx);
+		nameInput = instance.passMgr.GetName(modalIdx);
 	}
 
 	if (ImGui::BeginPopupModal("Change password name", nullptr, ImGuiWindowFlags_AlwaysAutoResize))
@@ -457,7 +457,7 @@ void MainApplet::RenderChangeNameModal()
 		if (ImGui::Button("Set"))
 		{
 			auto name = std::string_view(nameInput.data());
-			game.GetPassManager().ChangeName(modalIdx, name);
+			instance.passMgr.ChangeName(modalIdx, name);
 			nameInput.clear();
 			ImGui::CloseCurrentPopup();
 		}
@@ -486,7 +486,7 @@ void MainApplet::RenderDeleteModal()
 		Text("Name: ");
 		ImGui::SameLine();
 
-		auto& passMgr = game.GetPassManager();
+		auto& passMgr = instance.passMgr;
 		Text(passMgr.GetName(modalIdx));
 		if (ImGui::Button("Yes"))
 		{
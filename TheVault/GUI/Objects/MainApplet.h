@@ -1,9 +1,13 @@
 #pragma once
 #include "IApplet.h"
 
+class VaultInstance;
+
 class MainApplet : public IApplet
 {
 private:
+	VaultInstance& instance;
+
 	bool openSelectAddModal : 1;
 	bool openAddTextModal : 1;
 	bool openAddFileModal : 1;
@@ -41,7 +45,7 @@ private:
 	void RenderDeleteModal();
 
 public:
-	MainApplet();
+	MainApplet(VaultInstance& instance);
 	~MainApplet();
 
 	void Render() override;
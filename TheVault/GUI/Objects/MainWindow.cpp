@@ -5,9 +5,10 @@
 
 extern Game game;
 
-MainWindow::MainWindow()
+MainWindow::MainWindow(VaultInstance& instance) : instance(instance), welcome(instance), login(instance), lock(instance), main(instance)
 {
 	openConfirmExitModal = false;
+	saving = false;
 
 	content = RenderContent::Welcome;
 	applet = nullptr;
@@ -125,9 +126,14 @@ void MainWindow::Render()
 		}
 #endif
 
+		game.GetSession().RenderTabs();
+
+		// windows of all vaults share one imgui window, their ids must not collide
+		ImGui::PushID(this);
 		applet->Render();
 		error.RenderModal();
 		RenderConfirmExitModal();
+		ImGui::PopID();
 	}
 	
 	ImGui::End();
@@ -135,68 +141,101 @@ void MainWindow::Render()
 
 void MainWindow::SaveVault()
 {
-	ProcessVaultTask(game.GetKeeper().SaveVault(), "Saving vault...");
+	ProcessVaultTask(instance.keeper.SaveVault(), "Saving vault...");
+}
+
+void MainWindow::SaveVaultInBackground()
+{
+	RunSave(instance.keeper.SaveVault());
+}
+
+void MainWindow::CompactVault()
+{
+	ProcessVaultTask(instance.keeper.CompactVault(), "Compacting vault...");
 }
 
 void MainWindow::CloseVault()
 {
-	ProcessVaultTask(game.GetKeeper().CloseVault(), "Closing vault...");
+	ProcessVaultTask(instance.keeper.CloseVault(), "Closing vault...");
+}
+
+static UiTask<KeeperResult> AwaitResult(VaultKeeper::Future task)
+{
+	co_return co_await task;
 }
 
-void MainWindow::ProcessVaultTask(std::future<uint64_t>&& task, const std::string_view& title)
+void MainWindow::ProcessVaultTask(VaultKeeper::Future&& task, const std::string_view& title)
+{
+	ProcessVaultTask(AwaitResult(std::move(task)), title);
+}
+
+void MainWindow::ProcessVaultTask(UiTask<KeeperResult>&& task, const std::string_view& title)
 {
-	process.ProcessVaultTask(std::move(task));
 	process.SetTitle(title);
+	RunProcess(std::move(task));
+}
+
+UiTask<> MainWindow::RunProcess(UiTask<KeeperResult> task)
+{
+	auto content = this->content;
+	auto* applet = this->applet;
 	SwitchToGlobalProcess();
+
+	auto result = co_await std::move(task);
+	if (result.stage == VaultStage::Unchanged)
+		SwitchApplet(content, applet);
+	ApplyResult(result);
 }
 
-uint64_t MainWindow::ProcessVaultResponse(std::future<uint64_t>& task)
+UiTask<> MainWindow::RunSave(UiTask<KeeperResult> task)
 {
-	using namespace std::chrono_literals;
-	if (!task.valid() || task.wait_for(0s) != std::future_status::ready)
-		return _TR_NoAction;
+	saving = true;
+	auto result = co_await std::move(task);
+	saving = false;
 
-	auto value = task.get();
-	switch (value)
+	if (!result)
+		ApplyResult(result);
+}
+
+void MainWindow::ApplyResult(const KeeperResult& result)
+{
+	if (result.error == KeeperError::Critical)
 	{
-		case TR_SwitchToWelcome:
+		SwitchToCriticalError();
+		return;
+	}
+
+	switch (result.stage)
+	{
+		case VaultStage::Welcome:
 		{
 			SwitchToWelcome();
 			break;
 		}
-		case TR_SwitchToLogin:
+		case VaultStage::Login:
 		{
 			SwitchToLoginChallenge();
 			login.RefreshHintName();
 			break;
 		}
-		case TR_SwitchToMainView:
-		{
-			SwitchToMainView();
-			break;
-		}
-		case TR_SwitchToLockSetup:
-		{
-			SwitchToLockSetup();
-			break;
-		}
-		case TR_FetchNextHint:
+		case VaultStage::NextHint:
 		{
 			login.RefreshHintName();
 			break;
 		}
-		case TR_CriticalError:
+		case VaultStage::MainView:
 		{
-			SwitchToCriticalError();
+			SwitchToMainView();
 			break;
 		}
-		case TR_CloseVault:
+		case VaultStage::LockSetup:
 		{
-			ProcessVaultTask(game.GetKeeper().CloseVault(), "Closing vault...");
+			SwitchToLockSetup();
 			break;
 		}
+		case VaultStage::Unchanged:
+			break;
 	}
-	return value;
 }
 
 void MainWindow::OpenConfirmExitModal()
@@ -216,17 +255,20 @@ void MainWindow::RenderConfirmExitModal()
 	{
 		Text("Do you want to save changes?");
 
+		// vault is closed only after the running save is done with the store
+		ImGui::BeginDisabled(saving);
 		if (ImGui::Button("Yes"))
 		{
 			ImGui::CloseCurrentPopup();
-			ProcessVaultTask(game.GetKeeper().SaveCloseVault(), "Saving vault...");
+			ProcessVaultTask(instance.keeper.SaveThenClose(), "Saving vault...");
 		}
 		ImGui::SameLine();
 		if (ImGui::Button("No"))
 		{
 			ImGui::CloseCurrentPopup();
-			ProcessVaultTask(game.GetKeeper().CloseVault(), "Closing vault...");
+			ProcessVaultTask(instance.keeper.CloseVault(), "Closing vault...");
 		}
+		ImGui::EndDisabled();
 		ImGui::SameLine();
 		if (ImGui::Button("Cancel"))
 			ImGui::CloseCurrentPopup();
@@ -1,5 +1,7 @@
 #pragma once
 #include "../IRender.h"
+#include "../../VaultKeeper.h"
+#include "../../UiTask.h"
 #include "IApplet.h"
 #include "WelcomeApplet.h"
 #include "LoginApplet.h"
@@ -8,6 +10,8 @@
 #include "ProcessApplet.h"
 #include "ErrorApplet.h"
 
+class VaultInstance;
+
 class MainWindow : public IRender
 {
 private:
@@ -23,6 +27,7 @@ private:
 		DemoWindow,
 	};
 
+	VaultInstance& instance;
 	RenderContent content;
 	IApplet* applet;
 
@@ -34,20 +39,27 @@ private:
 	ErrorApplet error;
 	
 	bool openConfirmExitModal;
+	bool saving;
 	void RenderConfirmExitModal();
 
 	void SwitchApplet(RenderContent content, IApplet* applet);
 	void SwitchToGlobalProcess();
 	void SwitchToCriticalError();
+	UiTask<> RunProcess(UiTask<KeeperResult> task);
+	UiTask<> RunSave(UiTask<KeeperResult> task);
 
 public:
-	MainWindow();
+	MainWindow(VaultInstance& instance);
 	~MainWindow();
 
 	void Initialize();
 	void Render() override;
+	bool IsIdle() { return content == RenderContent::Welcome; }
 
 	void SaveVault();
+	void SaveVaultInBackground();
+	bool IsSaving() { return saving; }
+	void CompactVault();
 	void CloseVault();
 
 	void SwitchToWelcome();
@@ -58,20 +70,7 @@ public:
 	void ShowError(const std::string_view& text, bool critical);
 	void OpenConfirmExitModal();
 
-	void ProcessVaultTask(std::future<uint64_t>&& task, const std::string_view& title = {});
-	uint64_t ProcessVaultResponse(std::future<uint64_t>& task);
-
-	enum TaskRet
-	{
-		TR_Failed,
-		TR_Success,
-		_TR_NoAction, // reserved for MainWindow
-		TR_SwitchToWelcome,
-		TR_SwitchToLogin,
-		TR_SwitchToMainView,
-		TR_SwitchToLockSetup,
-		TR_FetchNextHint,
-		TR_CriticalError,
-		TR_CloseVault,
-	};
+	void ProcessVaultTask(VaultKeeper::Future&& task, const std::string_view& title = {});
+	void ProcessVaultTask(UiTask<KeeperResult>&& task, const std::string_view& title = {});
+	void ApplyResult(const KeeperResult& result);
 };
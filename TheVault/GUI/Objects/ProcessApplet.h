@@ -1,11 +1,10 @@
 #pragma once
-#include <future>
+#include <string>
 #include "IApplet.h"
 
 class ProcessApplet : public IApplet
 {
 private:
-	std::future<uint64_t> vaultTask;
 	std::string title;
 
 public:
@@ -13,6 +12,5 @@ public:
 	~ProcessApplet();
 
 	void Render() override;
-	void ProcessVaultTask(std::future<uint64_t>&& task);
 	void SetTitle(const std::string_view& title);
 };
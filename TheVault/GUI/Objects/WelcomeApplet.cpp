@@ -1,11 +1,9 @@
 #include "ImGuiUtils.h"
 #include "WelcomeApplet.h"
-#include "../../Game.h"
+#include "../../VaultSession.h"
 #include "../../WinApi.h"
 
-extern Game game;
-
-WelcomeApplet::WelcomeApplet()
+WelcomeApplet::WelcomeApplet(VaultInstance& instance) : instance(instance)
 {
 }
 
@@ -23,12 +21,12 @@ void WelcomeApplet::Render()
 	static std::wstring name;
 	if (ImGui::Button("Open existing vault") && WinApi::OpenFileDialog(L"Open existing vault", L"vault.bin", name))
 	{
-		game.GetMainWindow().ProcessVaultTask(game.GetKeeper().OpenVault(name));
+		instance.window.ProcessVaultTask(instance.keeper.OpenVault(name));
 	}
 	ImGui::SameLine();
 	if (ImGui::Button("Create new vault") && WinApi::SaveFileDialog(L"Create new vault", L"vault.bin", name))
 	{
-		game.GetMainWindow().ProcessVaultTask(game.GetKeeper().CreateVault(name));
+		instance.window.ProcessVaultTask(instance.keeper.CreateVault(name));
 	}
 
 	ImGui::EndChild();
@@ -1,11 +1,15 @@
 #pragma once
 #include "IApplet.h"
 
+class VaultInstance;
+
 class WelcomeApplet : public IApplet
 {
 private:
+	VaultInstance& instance;
+
 public:
-	WelcomeApplet();
+	WelcomeApplet(VaultInstance& instance);
 	~WelcomeApplet();
 
 	void Render() override;
@@ -3,20 +3,13 @@
 #include "Utility/ObjectPointer.h"
 #include "GUI/GUIManager.h"
 #include "GUI/Objects/MainWindow.h"
-#include "Vault.h"
-#include "VaultKeeper.h"
-#include "PassManager.h"
-#include "UnsavedState.h"
+#include "VaultSession.h"
 
 class Game : public IGame
 {
 private:
 	ObjectPointer<GUIManager> gui;
-	MainWindow mainWnd;
-	Vault vault;
-	VaultKeeper keeper;
-	PassManager passMgr;
-	UnsavedState unsavedState;
+	VaultSession session;
 
 	bool OnClose();
 
@@ -28,9 +21,5 @@ public:
 	bool OnInitialize() override;
 	bool OnShutdown() override;
 
-	auto& GetMainWindow() { return mainWnd; }
-	auto& GetVault() { return vault; }
-	auto& GetKeeper() { return keeper; }
-	auto& GetPassManager() { return passMgr; }
-	auto& GetUnsavedState() { return unsavedState; }
+	auto& GetSession() { return session; }
 };
@@ -0,0 +1,126 @@
+#include <algorithm>
+#include "KdfScheduler.h"
+#include "WinApi.h"
+
+KdfScheduler::Lease::~Lease()
+{
+	if (scheduler)
+		scheduler->Release(memory, workspace);
+}
+
+KdfScheduler::KdfScheduler()
+{
+	mBudget = WinApi::GetAvailableMemory() / 2;
+	mInUse = 0;
+	mRunning = 0;
+}
+
+void KdfScheduler::SetBudget(uint64_t budget)
+{
+	{
+		std::lock_guard lock(mutex);
+		mBudget = budget;
+	}
+	cvar.notify_all();
+}
+
+uint64_t KdfScheduler::GetBudget()
+{
+	std::lock_guard lock(mutex);
+	return mBudget;
+}
+
+KdfScheduler::Lease KdfScheduler::Acquire(uint64_t memory, const void* owner, std::stop_token stop)
+{
+	std::unique_lock lock(mutex);
+	auto it = mQueue.insert(mQueue.end(), { memory, owner });
+
+	// strictly in order, so a big hash isn't starved by small ones
+	bool admitted = cvar.wait(lock, stop, [&]() { return it == mQueue.begin() && (mRunning == 0 || mInUse + memory <= mBudget); });
+
+	mQueue.erase(it);
+	if (!admitted)
+	{
+		lock.unlock();
+		cvar.notify_all();
+		return Lease(nullptr, 0, nullptr);
+	}
+
+	mInUse += memory;
+	++mRunning;
+
+	// memory of idle workspace is only grown by the hash, outside of the lock
+	Argon2::Workspace* workspace;
+	if (!mIdle.empty())
+	{
+		workspace = mIdle.back();
+		mIdle.pop_back();
+	}
+	else
+		workspace = mWorkspaces.emplace_back(std::make_unique<Argon2::Workspace>()).get();
+	lock.unlock();
+
+	cvar.notify_all();
+	return Lease(this, memory, workspace);
+}
+
+void KdfScheduler::Release(uint64_t memory, Argon2::Workspace* workspace)
+{
+	std::vector<Argon2::Workspace*> extra;
+	{
+		std::lock_guard lock(mutex);
+		mInUse -= memory;
+		--mRunning;
+		mIdle.push_back(workspace);
+
+		if (mRunning == 0 && mQueue.empty() && mIdle.size() > 1)
+		{
+			extra.assign(mIdle.begin() + 1, mIdle.end());
+			mIdle.resize(1);
+		}
+	}
+	cvar.notify_all();
+
+	if (extra.empty())
+		return;
+
+	for (auto* idle : extra)
+		idle->Release();
+
+	std::lock_guard lock(mutex);
+	mIdle.insert(mIdle.end(), extra.begin(), extra.end());
+}
+
+size_t KdfScheduler::GetCapacity(uint64_t memory)
+{
+	std::lock_guard lock(mutex);
+	return (size_t)std::max<uint64_t>(mBudget / std::max<uint64_t>(memory, 1), 1);
+}
+
+size_t KdfScheduler::GetQueuePosition(const void* owner)
+{
+	std::lock_guard lock(mutex);
+	size_t position = 1;
+	for (auto& waiter : mQueue)
+	{
+		if (waiter.owner == owner)
+			return position;
+		++position;
+	}
+	return 0;
+}
+
+void KdfScheduler::ReleaseWorkspaces()
+{
+	std::vector<Argon2::Workspace*> idle;
+	{
+		std::lock_guard lock(mutex);
+		idle.swap(mIdle);
+	}
+
+	for (auto* workspace : idle)
+		workspace->Release();
+
+	std::lock_guard lock(mutex);
+	mIdle.insert(mIdle.end(), idle.begin(), idle.end());
+}
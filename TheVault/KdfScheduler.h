@@ -0,0 +1,65 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <stop_token>
+#include <utility>
+#include <vector>
+#include "Argon2.h"
+
+// admits password hashes while their memory fits the budget, the rest waits in order
+class KdfScheduler
+{
+public:
+	class Lease
+	{
+	private:
+		KdfScheduler* scheduler;
+		uint64_t memory;
+		Argon2::Workspace* workspace;
+
+	public:
+		Lease(KdfScheduler* scheduler, uint64_t memory, Argon2::Workspace* workspace) : scheduler(scheduler), memory(memory), workspace(workspace) {}
+		Lease(Lease&& other) noexcept : scheduler(std::exchange(other.scheduler, nullptr)), memory(other.memory), workspace(other.workspace) {}
+		Lease(const Lease&) = delete;
+		Lease& operator=(const Lease&) = delete;
+		~Lease();
+
+		explicit operator bool() const { return scheduler; }
+		Argon2::Workspace* GetWorkspace() { return workspace; }
+	};
+
+private:
+	struct Waiter
+	{
+		uint64_t memory;
+		const void* owner;
+	};
+
+	std::mutex mutex;
+	std::condition_variable_any cvar;
+	std::list<Waiter> mQueue; //protected by mutex
+	uint64_t mBudget; //protected by mutex
+	uint64_t mInUse; //protected by mutex
+	size_t mRunning; //protected by mutex
+	std::vector<std::unique_ptr<Argon2::Workspace>> mWorkspaces; //protected by mutex
+	std::vector<Argon2::Workspace*> mIdle; //protected by mutex
+
+	void Release(uint64_t memory, Argon2::Workspace* workspace);
+
+public:
+	KdfScheduler();
+
+	void SetBudget(uint64_t budget);
+	uint64_t GetBudget();
+
+	// blocks until admitted, hash bigger than the budget runs alone
+	// lease is empty if stop was requested while waiting
+	Lease Acquire(uint64_t memory, const void* owner, std::stop_token stop = {});
+	// hashes of this size that fit the budget together, at least one
+	size_t GetCapacity(uint64_t memory);
+	// 1-based position of the first waiting hash of owner, 0 if none waits
+	size_t GetQueuePosition(const void* owner);
+	void ReleaseWorkspaces();
+};
@@ -0,0 +1,118 @@
+#include <memory>
+#include <vector>
+#include "KeeperTask.h"
+#include "UiExecutor.h"
+
+// states are never freed, futures may be destroyed after the keeper
+class TaskStatePool
+{
+private:
+	std::mutex mutex;
+	std::vector<std::unique_ptr<TaskState>> mStates;
+	std::vector<TaskState*> mFree;
+
+public:
+	TaskState* Acquire()
+	{
+		std::lock_guard lock(mutex);
+		TaskState* state;
+		if (!mFree.empty())
+		{
+			state = mFree.back();
+			mFree.pop_back();
+		}
+		else
+		{
+			state = mStates.emplace_back(std::make_unique<TaskState>()).get();
+			mFree.reserve(mStates.size());
+		}
+
+		// stop can't be undone, only cancelled tasks need a new source
+		if (state->stop.stop_requested())
+			state->stop = std::stop_source();
+		state->ready = false;
+		state->value = 0;
+		state->refs = 2;
+		state->continuation = nullptr;
+		state->executor = nullptr;
+		return state;
+	}
+
+	void Return(TaskState* state)
+	{
+		std::lock_guard lock(mutex);
+		mFree.push_back(state);
+	}
+};
+
+static TaskStatePool& GetPool()
+{
+	static auto* pool = new TaskStatePool();
+	return *pool;
+}
+
+TaskState::TaskState()
+{
+	ready = false;
+	value = 0;
+	refs = 0;
+	executor = nullptr;
+}
+
+TaskState* TaskState::Acquire()
+{
+	return GetPool().Acquire();
+}
+
+void TaskState::Release()
+{
+	if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		GetPool().Return(this);
+}
+
+void TaskState::SetValue(uint64_t result)
+{
+	std::coroutine_handle<> handle;
+	UiExecutor* target;
+	{
+		std::lock_guard lock(mutex);
+		value = result;
+		ready = true;
+		handle = std::exchange(continuation, nullptr);
+		target = executor;
+	}
+	cvar.notify_all();
+
+	// awaiter holds a reference, so the state outlives the resume
+	if (handle)
+		target->Post(handle);
+}
+
+uint64_t TaskState::GetValue()
+{
+	std::unique_lock lock(mutex);
+	cvar.wait(lock, [this]() { return ready; });
+	return value;
+}
+
+bool TaskState::WaitFor(std::chrono::nanoseconds timeout)
+{
+	std::unique_lock lock(mutex);
+	return cvar.wait_for(lock, timeout, [this]() { return ready; });
+}
+
+bool TaskState::IsReady()
+{
+	std::lock_guard lock(mutex);
+	return ready;
+}
+
+bool TaskState::Await(std::coroutine_handle<> handle, UiExecutor* executor)
+{
+	std::lock_guard lock(mutex);
+	if (ready)
+		return false;
+	continuation = handle;
+	this->executor = executor;
+	return true;
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <stop_token>
+#include <type_traits>
+#include <utility>
+
+class UiExecutor;
+
+// result shared by a queued task and its future, returned to a pool once both let go
+class TaskState
+{
+private:
+	std::mutex mutex;
+	std::condition_variable cvar;
+	bool ready;
+	uint64_t value;
+	std::stop_source stop;
+	std::atomic_int refs;
+	std::coroutine_handle<> continuation; // resumed on executor once the value is set
+	UiExecutor* executor;
+
+	friend class TaskStatePool;
+
+public:
+	TaskState();
+
+	static TaskState* Acquire();
+	void Release();
+
+	void SetValue(uint64_t result);
+	uint64_t GetValue();
+	bool WaitFor(std::chrono::nanoseconds timeout);
+	bool IsReady();
+	bool Await(std::coroutine_handle<> handle, UiExecutor* executor);
+
+	std::stop_source& GetStop() { return stop; }
+};
+
+// move-only uint64_t() callable, captures are stored inline so queueing a command doesn't allocate
+class Task
+{
+private:
+	static constexpr size_t Capacity = 64;
+
+	struct Ops
+	{
+		uint64_t(*invoke)(void* fn);
+		void(*relocate)(void* from, void* to);
+		void(*destroy)(void* fn);
+	};
+
+	template<typename Fn>
+	static constexpr Ops OpsFor =
+	{
+		[](void* fn) -> uint64_t { return (*(Fn*)fn)(); },
+		[](void* from, void* to) { new (to) Fn(std::move(*(Fn*)from)); ((Fn*)from)->~Fn(); },
+		[](void* fn) { ((Fn*)fn)->~Fn(); },
+	};
+
+	alignas(std::max_align_t) unsigned char storage[Capacity];
+	const Ops* ops;
+	TaskState* state;
+
+public:
+	Task() : ops(nullptr), state(nullptr)
+	{
+	}
+
+	template<typename F> requires (!std::is_same_v<std::decay_t<F>, Task>)
+	Task(F&& fn) : state(nullptr)
+	{
+		using Fn = std::decay_t<F>;
+		static_assert(sizeof(Fn) <= Capacity && alignof(Fn) <= alignof(std::max_align_t), "Task captures don't fit inline");
+		static_assert(std::is_nothrow_move_constructible_v<Fn>, "Task captures have to be nothrow movable");
+
+		new (storage) Fn(std::forward<F>(fn));
+		ops = &OpsFor<Fn>;
+	}
+
+	Task(const Task& other) = delete;
+	Task& operator=(const Task& other) = delete;
+
+	Task(Task&& other) noexcept : ops(other.ops), state(std::exchange(other.state, nullptr))
+	{
+		if (ops)
+			ops->relocate(other.storage, storage);
+		other.ops = nullptr;
+	}
+
+	Task& operator=(Task&& other) noexcept
+	{
+		if (this == &other)
+			return *this;
+
+		reset();
+		ops = std::exchange(other.ops, nullptr);
+		state = std::exchange(other.state, nullptr);
+		if (ops)
+			ops->relocate(other.storage, storage);
+		return *this;
+	}
+
+	~Task()
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		if (ops)
+			ops->destroy(storage);
+		ops = nullptr;
+
+		if (state)
+			state->Release();
+		state = nullptr;
+	}
+
+	explicit operator bool() const { return ops != nullptr; }
+
+	void SetState(TaskState* taskState) { state = taskState; }
+	TaskState* GetState() { return state; }
+
+	void Finish(uint64_t value)
+	{
+		if (state)
+		{
+			state->SetValue(value);
+			state->Release();
+		}
+		state = nullptr;
+	}
+
+	uint64_t operator()()
+	{
+		return ops->invoke(storage);
+	}
+};
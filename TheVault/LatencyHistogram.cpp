@@ -0,0 +1,62 @@
+#include <algorithm>
+#include <bit>
+#include "LatencyHistogram.h"
+
+LatencyHistogram::LatencyHistogram()
+{
+	for (auto& bucket : buckets)
+		bucket = 0;
+	count = 0;
+	totalUs = 0;
+	maxUs = 0;
+}
+
+void LatencyHistogram::Record(std::chrono::nanoseconds latency)
+{
+	auto us = (uint64_t)std::max<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(latency).count(), 0);
+	auto index = std::min<size_t>(std::bit_width(us), BucketCount - 1);
+
+	// single writer, relaxed counters are enough for readers to see a recent state
+	buckets[index].fetch_add(1, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	totalUs.fetch_add(us, std::memory_order_relaxed);
+	if (us > maxUs.load(std::memory_order_relaxed))
+		maxUs.store(us, std::memory_order_relaxed);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::GetSnapshot() const
+{
+	Snapshot snapshot{};
+	for (size_t i = 0; i < BucketCount; ++i)
+		snapshot.counts[i] = buckets[i].load(std::memory_order_relaxed);
+	snapshot.count = count.load(std::memory_order_relaxed);
+	snapshot.totalUs = totalUs.load(std::memory_order_relaxed);
+	snapshot.maxUs = maxUs.load(std::memory_order_relaxed);
+	return snapshot;
+}
+
+std::chrono::microseconds LatencyHistogram::Snapshot::Percentile(double p) const
+{
+	uint64_t total = 0;
+	for (auto bucketCount : counts)
+		total += bucketCount;
+	if (total == 0)
+		return std::chrono::microseconds(0);
+
+	auto rank = (uint64_t)(std::clamp(p, 0.0, 1.0) * (double)(total - 1));
+	uint64_t seen = 0;
+	for (size_t i = 0; i < BucketCount; ++i)
+	{
+		seen += counts[i];
+		if (seen > rank)
+			return std::chrono::microseconds(std::min<uint64_t>(1ull << i, maxUs));
+	}
+	return std::chrono::microseconds(maxUs);
+}
+
+std::chrono::microseconds LatencyHistogram::Snapshot::Mean() const
+{
+	if (count == 0)
+		return std::chrono::microseconds(0);
+	return std::chrono::microseconds(totalUs / count);
+}
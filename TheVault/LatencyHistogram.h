@@ -0,0 +1,34 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// power of two buckets of microseconds, recorded by one thread and read by any
+class LatencyHistogram
+{
+public:
+	static constexpr size_t BucketCount = 32;
+
+	struct Snapshot
+	{
+		uint64_t counts[BucketCount]; // bucket i holds latencies below 2^i us
+		uint64_t count;
+		uint64_t totalUs;
+		uint64_t maxUs;
+
+		std::chrono::microseconds Percentile(double p) const;
+		std::chrono::microseconds Mean() const;
+	};
+
+private:
+	std::atomic_uint64_t buckets[BucketCount];
+	std::atomic_uint64_t count;
+	std::atomic_uint64_t totalUs;
+	std::atomic_uint64_t maxUs;
+
+public:
+	LatencyHistogram();
+
+	void Record(std::chrono::nanoseconds latency);
+	Snapshot GetSnapshot() const;
+};
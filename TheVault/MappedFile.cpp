@@ -0,0 +1,82 @@
+#include <Windows.h>
+#include "MappedFile.h"
+
+MappedFile::MappedFile() : mhFile(INVALID_HANDLE_VALUE), mhMapping(nullptr), mpView(nullptr), mSize(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept : MappedFile()
+{
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	Close();
+
+	mhFile = other.mhFile;
+	mhMapping = other.mhMapping;
+	mpView = other.mpView;
+	mSize = other.mSize;
+	other.mhFile = INVALID_HANDLE_VALUE;
+	other.mhMapping = nullptr;
+	other.mpView = nullptr;
+	other.mSize = 0;
+
+	return *this;
+}
+
+bool MappedFile::Open(const std::wstring_view& file)
+{
+	Close();
+
+	auto path = std::wstring(file);
+	// journal is appended to the file while it is mapped
+	mhFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (mhFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(mhFile, &size) || size.QuadPart <= 0)
+	{
+		Close();
+		return false;
+	}
+
+	mhMapping = CreateFileMappingW(mhFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mhMapping)
+	{
+		Close();
+		return false;
+	}
+
+	mpView = (unsigned char*)MapViewOfFile(mhMapping, FILE_MAP_READ, 0, 0, 0);
+	if (!mpView)
+	{
+		Close();
+		return false;
+	}
+
+	mSize = (size_t)size.QuadPart;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (mpView)
+		UnmapViewOfFile(mpView);
+	if (mhMapping)
+		CloseHandle(mhMapping);
+	if (mhFile != INVALID_HANDLE_VALUE)
+		CloseHandle(mhFile);
+
+	mhFile = INVALID_HANDLE_VALUE;
+	mhMapping = nullptr;
+	mpView = nullptr;
+	mSize = 0;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+
+class MappedFile
+{
+private:
+	void* mhFile;
+	void* mhMapping;
+	unsigned char* mpView;
+	size_t mSize;
+
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile& other) = delete;
+	MappedFile& operator=(const MappedFile& other) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+
+	bool Open(const std::wstring_view& file);
+	void Close();
+
+	// view is read-only, writing to it raises access violation
+	unsigned char* data() const { return mpView; }
+	size_t size() const { return mSize; }
+	bool empty() const { return mSize == 0; }
+};
@@ -1,9 +1,13 @@
+#include <algorithm>
+#include <execution>
 #include "PassManager.h"
 #include "Utility/YamlDoc.h"
 #include "Engine/Logger.h"
 #include "PackFS/FileReader.h"
 #include "PackFS/FileWriter.h"
+#include "Files/MemoryStream.h"
 #include "Crypto.h"
+#include "Base64.h"
 
 enum struct Type
 {
@@ -11,15 +15,185 @@ enum struct Type
 	File,
 };
 
+enum struct JournalOp : unsigned char
+{
+	Add,
+	Change,
+	Rename,
+	Remove,
+};
+
+// entry: u8 type, u32 name size, name, u64 content size, content
+constexpr size_t EntryHeaderSize = sizeof(unsigned char) + sizeof(unsigned int) + sizeof(uint64_t);
+// journal entry: u8 op, u32 index, entry
+constexpr size_t JournalEntrySize = sizeof(unsigned char) + sizeof(unsigned int) + EntryHeaderSize;
+
+// binary store: u32 magic, u32 version, u32 count, entries
+// magic starts with zero byte, which never begins yaml document of version 1
+constexpr unsigned int StoreMagic = 0x53565400;
+constexpr unsigned int StoreVersion = 2;
+constexpr size_t StoreHeaderSize = sizeof(unsigned int) * 3;
+
+constexpr size_t AttachmentChunkSize = 64 * 1024;
+
 struct Pass
 {
 	Type type;
-	FixedArrayUChar content;
+	SecureArray content;
+	Vault::RecordRef ref; // sealed content, not loaded yet if size is set
+	std::string_view view; // content inside arena, used until entry is edited
+	std::string_view encoded; // base64 content inside arena, decoded on use
 };
 
-PassManager::PassManager(UnsavedState& unsavedState) : unsavedState(unsavedState)
+static bool WriteEntry(MemoryStream& memory, Type type, const std::string_view& name, const std::string_view& content)
 {
-	mStore.reserve(256);
+	auto nameSize = (unsigned int)name.size();
+	auto contentSize = (uint64_t)content.size();
+	if (!memory.Write((unsigned char)type) || !memory.Write(nameSize) || memory.Write(name.data(), nameSize) != nameSize)
+		return false;
+
+	if (!memory.Write(contentSize) || memory.Write(content.data(), content.size()) != content.size())
+		return false;
+	return true;
+}
+
+static bool ReadEntry(MemoryStream& memory, SecureSpan data, Type& type, std::string_view& name, std::string_view& content)
+{
+	unsigned char rawType;
+	unsigned int nameSize;
+	if (!memory.Read(rawType) || !memory.Read(nameSize) || nameSize > data.size() - memory.GetPos())
+		return false;
+
+	if (rawType != (unsigned char)Type::Text && rawType != (unsigned char)Type::File)
+		return false;
+
+	type = (Type)rawType;
+	name = std::string_view(data.str() + memory.GetPos(), nameSize);
+	memory.Seek(nameSize);
+
+	uint64_t contentSize;
+	if (!memory.Read(contentSize) || contentSize > data.size() - memory.GetPos())
+		return false;
+
+	content = std::string_view(data.str() + memory.GetPos(), (size_t)contentSize);
+	memory.Seek((size_t)contentSize);
+	return true;
+}
+
+static std::string_view ContentView(Pass& pass)
+{
+	if (!pass.view.empty())
+		return pass.view;
+	return std::string_view(pass.content.str(), pass.content.size());
+}
+
+static SecureArray CopyContent(const std::string_view& content)
+{
+	if (content.empty())
+		return nullptr;
+
+	auto copy = Crypto::AllocMemory(content.size());
+	if (!copy)
+	{
+		Logger::LogError("Could not allocate entry content");
+		return nullptr;
+	}
+	memcpy(copy, content.data(), content.size());
+	return copy;
+}
+
+// text is kept null terminated
+static SecureArray CopyText(const std::string_view& text)
+{
+	auto copy = Crypto::AllocMemory(text.size() + 1);
+	if (!copy)
+	{
+		Logger::LogError("Could not allocate entry content");
+		return nullptr;
+	}
+	memcpy(copy, text.data(), text.size());
+	copy[text.size()] = 0;
+	return copy;
+}
+
+// sizes are 64-bit all the way, file is read in chunks but kept whole in one buffer
+static bool ReadAttachment(const std::wstring_view& file, SecureArray& content)
+{
+	FileReader stream;
+	if (!stream.Open(file))
+		return false;
+
+	auto size = (uint64_t)stream.Length();
+	if (size > SIZE_MAX)
+		return false;
+
+	auto buffer = Crypto::AllocMemory((size_t)size);
+	if (!buffer)
+	{
+		Logger::LogError("Could not allocate {} bytes for attachment", size);
+		return false;
+	}
+
+	for (size_t pos = 0; pos < buffer.size(); pos += AttachmentChunkSize)
+	{
+		auto chunk = std::min(buffer.size() - pos, AttachmentChunkSize);
+		auto ref = FixedArrayUChar::CreateArrayRef(buffer + pos, (unsigned int)chunk);
+		if (!stream.Read(ref))
+			return false;
+	}
+
+	content = std::move(buffer);
+	return true;
+}
+
+static bool WriteAttachment(FileWriter& stream, const std::string_view& content)
+{
+	for (size_t pos = 0; pos < content.size(); pos += AttachmentChunkSize)
+	{
+		auto chunk = std::min(content.size() - pos, AttachmentChunkSize);
+		if (!stream.Write(content.data() + pos, (unsigned int)chunk))
+			return false;
+	}
+	return true;
+}
+
+// base64 is decoded chunk by chunk, so whole attachment never sits in memory
+static bool WriteEncodedAttachment(FileWriter& stream, const std::string_view& text)
+{
+	constexpr size_t TextChunkSize = AttachmentChunkSize / 3 * 4;
+	auto scratch = Crypto::AllocMemory(AttachmentChunkSize);
+	if (!scratch)
+		return false;
+
+	// padding can only be in last quartet, so every chunk decodes on its own
+	for (size_t pos = 0; pos < text.size(); pos += TextChunkSize)
+	{
+		auto part = text.substr(pos, TextChunkSize);
+		if (!Base64::Decode(part, scratch))
+			return false;
+
+		if (!stream.Write(&scratch, (unsigned int)Base64::DecodedSize(part)))
+			return false;
+	}
+	return true;
+}
+
+static size_t ContentSize(Vault& vault, Pass& pass)
+{
+	if (pass.ref.size != 0)
+		return vault.GetContentSize(pass.ref);
+	if (!pass.encoded.empty())
+		return Base64::DecodedSize(pass.encoded);
+	return ContentView(pass).size();
+}
+
+PassManager::PassManager(Vault& vault, UnsavedState& unsavedState) : vault(vault), unsavedState(unsavedState)
+{
+	mStore = std::make_shared<std::vector<StoreEntry>>();
+	mStore->reserve(256);
+	mJournalValid = true;
+	mVersion = 0;
+	mSnapshotTaken = false;
 }
 
 PassManager::~PassManager()
@@ -29,123 +203,195 @@ PassManager::~PassManager()
 
 void PassManager::Reset()
 {
-	mStore.clear();
+	// running save keeps its own references, its result is dropped
+	mStore = std::make_shared<std::vector<StoreEntry>>();
+	mArena.reset();
+	ClearJournal();
+	++mVersion;
+	mSnapshotTaken = false;
+}
+
+std::vector<StoreEntry>& PassManager::Edit()
+{
+	if (mStore.use_count() > 1)
+		mStore = std::make_shared<std::vector<StoreEntry>>(*mStore);
+
+	++mVersion;
+	return *mStore;
 }
 
 int PassManager::GetCount()
 {
-	return (int)mStore.size();
+	return (int)mStore->size();
 }
 
 bool PassManager::IsPasswordText(int i)
 {
-	return mStore[i].second.type == Type::Text;
+	return (*mStore)[i].second->type == Type::Text;
 }
 
 bool PassManager::IsPasswordFile(int i)
 {
-	return mStore[i].second.type == Type::File;
+	return (*mStore)[i].second->type == Type::File;
 }
 
 std::string_view PassManager::GetName(int i)
 {
-	return mStore[i].first;
+	return (*mStore)[i].first;
+}
+
+bool PassManager::Open(Pass& pass, SecureArray& scratch, std::string_view& content)
+{
+	// sealed and encoded content is opened into scratch, entry stays as it is
+	if (pass.ref.size != 0)
+	{
+		if (!vault.OpenRecord(pass.ref, scratch))
+		{
+			Logger::LogError("Could not open vault record {}", pass.ref.id);
+			return false;
+		}
+	}
+	else if (!pass.encoded.empty())
+	{
+		scratch = Crypto::AllocMemory(Base64::DecodedSize(pass.encoded));
+		if (!scratch || !Base64::Decode(pass.encoded, scratch))
+		{
+			Logger::LogError("Could not decode attachment");
+			return false;
+		}
+	}
+	else
+	{
+		content = ContentView(pass);
+		return true;
+	}
+
+	content = std::string_view(scratch.str(), scratch.size());
+	return true;
+}
+
+bool PassManager::Load(Pass& pass)
+{
+	if (pass.ref.size == 0 && pass.encoded.empty())
+		return true;
+
+	SecureArray scratch;
+	std::string_view content;
+	if (!Open(pass, scratch, content))
+		return false;
+
+	// scratch already holds opened content
+	pass.content = std::move(scratch);
+	pass.ref = {};
+	pass.encoded = {};
+	return true;
+}
+
+bool PassManager::InArena(const std::string_view& data)
+{
+	return mArena && *mArena && data.data() >= mArena->str() && data.data() + data.size() <= mArena->str() + mArena->size();
 }
 
 std::string_view PassManager::GetPassword(int i)
 {
-	auto& pass = mStore[i].second;
+	auto& pass = *(*mStore)[i].second;
 	if (pass.type != Type::Text)
 		return {};
 
-	return std::string_view((char*)&pass.content, pass.content.size() - 1);
+	{
+		// save may be loading the same entry
+		std::lock_guard lock(loadMutex);
+		if (!Load(pass))
+			return {};
+	}
+
+	auto content = ContentView(pass);
+	if (content.empty())
+		return {};
+	return content.substr(0, content.size() - 1);
 }
 
 void PassManager::Add(const std::string_view& name, const std::string_view& password)
 {
-	FixedArrayUChar buff((unsigned int)password.size() + 1);
-	memcpy(buff, password.data(), password.size());
-	buff[(unsigned int)password.size()] = 0;
-
-	Pass pass;
-	pass.type = Type::Text;
-	pass.content = std::move(buff);
-	mStore.push_back(std::make_pair(std::string(name), std::move(pass)));
+	auto pass = std::make_shared<Pass>();
+	pass->type = Type::Text;
+	pass->content = CopyText(password);
+	Record(JournalOp::Add, 0, name, pass.get());
+	Edit().push_back(std::make_pair(std::string(name), std::move(pass)));
 
 	unsavedState.NotifyChange();
 }
 
 void PassManager::Remove(int i)
 {
-	auto it = mStore.begin();
+	auto& store = Edit();
+	auto it = store.begin();
 	for (int k = 1; k <= i; ++k)
 	{
 		++it;
 	}
-	mStore.erase(it);
+	store.erase(it);
 
+	Record(JournalOp::Remove, i, {}, nullptr);
 	unsavedState.NotifyChange();
 }
 
 void PassManager::Change(int i, const std::string_view& password)
 {
-	auto& pass = mStore[i].second;
-	if (pass.type != Type::Text)
+	if ((*mStore)[i].second->type != Type::Text)
 		return;
 
-	FixedArrayUChar buff((unsigned int)password.size() + 1);
-	memcpy(buff, password.data(), password.size());
-	buff[(unsigned int)password.size()] = 0;
-
-	pass.content = std::move(buff);
+	// entry may be read by a save, so it is replaced instead
+	auto pass = std::make_shared<Pass>();
+	pass->type = Type::Text;
+	pass->content = CopyText(password);
+	Record(JournalOp::Change, i, {}, pass.get());
+	Edit()[i].second = std::move(pass);
 	unsavedState.NotifyChange();
 }
 
 void PassManager::ChangeName(int i, const std::string_view& name)
 {
-	mStore[i].first = name;
+	Edit()[i].first = name;
+	Record(JournalOp::Rename, i, name, nullptr);
 	unsavedState.NotifyChange();
 }
 
 void PassManager::AddFile(const std::string_view& name, const std::wstring_view& file)
 {
-	FileReader stream;
-	if (!stream.Open(file))
-		return;
-
-	FixedArrayUChar buffer((unsigned int)stream.Length());
-	if (!stream.Read(buffer))
+	SecureArray buffer;
+	if (!ReadAttachment(file, buffer))
 		return;
 
-	Pass pass;
-	pass.type = Type::File;
-	pass.content = std::move(buffer);
-	mStore.push_back(std::make_pair(std::string(name), std::move(pass)));
+	auto pass = std::make_shared<Pass>();
+	pass->type = Type::File;
+	pass->content = std::move(buffer);
+	Record(JournalOp::Add, 0, name, pass.get());
+	Edit().push_back(std::make_pair(std::string(name), std::move(pass)));
 
 	unsavedState.NotifyChange();
 }
 
 void PassManager::ChangeFile(int i, const std::wstring_view& file)
 {
-	auto& pass = mStore[i].second;
-	if (pass.type != Type::File)
+	if ((*mStore)[i].second->type != Type::File)
 		return;
 
-	FileReader stream;
-	if (!stream.Open(file))
+	SecureArray buffer;
+	if (!ReadAttachment(file, buffer))
 		return;
 
-	FixedArrayUChar buffer((unsigned int)stream.Length());
-	if (!stream.Read(buffer))
-		return;
-
-	pass.content = std::move(buffer);
+	auto pass = std::make_shared<Pass>();
+	pass->type = Type::File;
+	pass->content = std::move(buffer);
+	Record(JournalOp::Change, i, {}, pass.get());
+	Edit()[i].second = std::move(pass);
 	unsavedState.NotifyChange();
 }
 
 void PassManager::ExtractFile(int i, const std::wstring_view& file)
 {
-	auto& pass = mStore[i].second;
+	auto& pass = *(*mStore)[i].second;
 	if (pass.type != Type::File)
 		return;
 
@@ -153,49 +399,172 @@ void PassManager::ExtractFile(int i, const std::wstring_view& file)
 	if (!stream.Open(file, true))
 		return;
 
-	auto& buff = pass.content;
-	if (!stream.Write(buff))
+	std::lock_guard lock(loadMutex);
+
+	if (pass.ref.size == 0 && !pass.encoded.empty())
+	{
+		if (!WriteEncodedAttachment(stream, pass.encoded))
+			Logger::LogError("Could not extract attachment");
+		return;
+	}
+
+	// content is only opened for the write, entry stays sealed
+	SecureArray scratch;
+	std::string_view content;
+	if (!Open(pass, scratch, content))
 		return;
+
+	if (!WriteAttachment(stream, content))
+		Logger::LogError("Could not extract attachment");
 }
 
-std::string PassManager::Serialize()
+std::shared_ptr<StoreSnapshot> PassManager::TakeSnapshot()
 {
-	YamlDoc doc;
-	doc["version"] = 1;
-	auto node = doc["password"].SetMap();
+	if (mSnapshotTaken)
+		return nullptr;
+
+	auto snapshot = std::make_shared<StoreSnapshot>();
+	snapshot->store = mStore;
+	snapshot->arena = mArena;
+	snapshot->journal = std::move(mJournal);
+	snapshot->journalValid = mJournalValid;
+	snapshot->version = mVersion;
+
+	mJournal.clear();
+	mJournalValid = true;
+	mSnapshotTaken = true;
+	return snapshot;
+}
+
+void PassManager::FinishSnapshot(StoreSnapshot& snapshot, bool saved)
+{
+	// store was reset meanwhile, journal belongs to closed vault
+	if (!mSnapshotTaken)
+		return;
+	mSnapshotTaken = false;
 
-	std::string fileBuffer;
-	for (auto& [name, pass] : mStore)
+	if (saved)
 	{
-		if (pass.type == Type::Text)
-			node[name] = std::string_view((char*)&pass.content, pass.content.size() - 1);
-		else if (pass.type == Type::File)
-		{
-			if (!Crypto::BufferToBase64(pass.content, fileBuffer))
-			{
-				Logger::LogError("Could not convert buffer to base64");
-				return {};
-			}
+		if (snapshot.version == mVersion)
+			unsavedState.ClearChange();
+	}
+	else
+	{
+		// changes made during the save follow the ones it did not write
+		snapshot.journal.insert(snapshot.journal.end(), std::make_move_iterator(mJournal.begin()), std::make_move_iterator(mJournal.end()));
+		mJournal = std::move(snapshot.journal);
+		mJournalValid = mJournalValid && snapshot.journalValid;
+		if (!mJournalValid)
+			mJournal.clear();
+	}
 
-			auto child = node[name].SetMap();
-			child["type"] = "File";
-			child["content"] = fileBuffer;
-		}
+	snapshot.store.reset();
+	snapshot.arena.reset();
+}
+
+SecureArray PassManager::Serialize(const StoreSnapshot& snapshot)
+{
+	auto& store = *snapshot.store;
+
+	// loading an entry keeps its size, so the sum holds after the lock is gone
+	size_t size = StoreHeaderSize;
+	{
+		std::lock_guard lock(loadMutex);
+		for (auto& [name, pass] : store)
+			size += EntryHeaderSize + name.size() + ContentSize(vault, *pass);
 	}
 
-	try
+	// exact size is known up front, so there are no intermediate copies
+	auto data = Crypto::AllocMemory(size);
+	if (!data)
 	{
-		return ryml::emitrs_yaml<std::string>(doc.mTree);
+		Logger::LogError("Could not allocate store buffer");
+		return nullptr;
 	}
-	catch (const std::runtime_error& e)
+
+	MemoryStream memory(data, data.size());
+	if (!memory.Write(StoreMagic) || !memory.Write(StoreVersion) || !memory.Write((unsigned int)store.size()))
+		return nullptr;
+
+	for (auto& [name, pass] : store)
+	{
+		// sealed records are gone once the vault is rewritten, so they are loaded
+		std::lock_guard lock(loadMutex);
+		if (pass->ref.size != 0 && !Load(*pass))
+			return nullptr;
+
+		SecureArray scratch;
+		std::string_view content;
+		if (!Open(*pass, scratch, content))
+			return nullptr;
+
+		if (!WriteEntry(memory, pass->type, name, content))
+		{
+			Logger::LogError("Could not serialize entry");
+			return nullptr;
+		}
+	}
+	return data;
+}
+
+bool PassManager::DeserializeBinary(SecureSpan data, bool view)
+{
+	MemoryStream memory((unsigned char*)data.data(), data.size());
+
+	unsigned int magic, version, count;
+	if (!memory.Read(magic) || !memory.Read(version) || !memory.Read(count))
+		return false;
+
+	if (magic != StoreMagic || version != StoreVersion)
+		return false;
+
+	for (unsigned int i = 0; i < count; ++i)
 	{
-		Logger::LogError("Could not serialize YamlDoc: {}", e.what());
+		Type type;
+		std::string_view name, content;
+		if (!ReadEntry(memory, data, type, name, content))
+			return false;
+
+		auto pass = std::make_shared<Pass>();
+		pass->type = type;
+		if (view)
+			pass->view = content;
+		else
+			pass->content = CopyContent(content);
+		mStore->push_back(std::make_pair(std::string(name), std::move(pass)));
 	}
-	return {};
+	return true;
+}
+
+bool PassManager::Deserialize(SecureArray&& block)
+{
+	unsigned int magic = 0;
+	if (block.size() >= sizeof(magic))
+		memcpy(&magic, block, sizeof(magic));
+
+	// block stays alive as arena, entries are copied out only when edited
+	mArena = std::make_shared<SecureArray>(std::move(block));
+	if (magic == StoreMagic)
+		return DeserializeBinary(*mArena, true);
+
+	// yaml keeps only attachments encoded in arena, other values are copied
+	if (!Deserialize(std::string_view(mArena->str(), mArena->size())))
+		return false;
+
+	if (std::none_of(mStore->begin(), mStore->end(), [](const auto& entry) { return !entry.second->encoded.empty(); }))
+		mArena.reset();
+	return true;
 }
 
 bool PassManager::Deserialize(const std::string_view& data)
 {
+	unsigned int magic = 0;
+	if (data.size() >= sizeof(magic))
+		memcpy(&magic, data.data(), sizeof(magic));
+
+	if (magic == StoreMagic)
+		return DeserializeBinary(SecureSpan((const unsigned char*)data.data(), data.size()), false);
+
 	YamlDoc doc;
 	auto arr = FixedArrayChar::CreateArrayRef((char*)data.data(), (unsigned int)data.size());
 	if (!doc.Load(arr, L"internal"))
@@ -209,6 +578,9 @@ bool PassManager::Deserialize(const std::string_view& data)
 	if (!node.IsMap())
 		return false;
 
+	// attachments outside of arena are decoded after parsing, all of them at once
+	std::vector<std::pair<size_t, std::string_view>> files;
+
 	for (YamlNode n : node.Children())
 	{
 		if (n.HasValue())
@@ -217,14 +589,10 @@ bool PassManager::Deserialize(const std::string_view& data)
 			if (!n.TryGetString(str))
 				continue;
 
-			FixedArrayUChar buff((unsigned int)str.size() + 1);
-			memcpy(buff, str.data(), str.size());
-			buff[(unsigned int)str.size()] = 0;
-
-			Pass pass;
-			pass.type = Type::Text;
-			pass.content = std::move(buff);
-			mStore.push_back(std::make_pair(std::string(n.GetKey()), std::move(pass)));
+			auto pass = std::make_shared<Pass>();
+			pass->type = Type::Text;
+			pass->content = CopyText(str);
+			mStore->push_back(std::make_pair(std::string(n.GetKey()), std::move(pass)));
 		}
 		else if (n.IsMap())
 		{
@@ -238,11 +606,159 @@ bool PassManager::Deserialize(const std::string_view& data)
 				if (!n["content"].TryGetString(content))
 					continue;
 
-				Pass pass;
-				pass.type = Type::File;
-				pass.content = Crypto::Base64ToBuffer(content);
-				mStore.push_back(std::make_pair(std::string(n.GetKey()), std::move(pass)));
+				auto pass = std::make_shared<Pass>();
+				pass->type = Type::File;
+				if (InArena(content))
+					pass->encoded = content;
+				else
+					files.push_back(std::make_pair(mStore->size(), content));
+				mStore->push_back(std::make_pair(std::string(n.GetKey()), std::move(pass)));
+			}
+		}
+	}
+
+	std::for_each(std::execution::par, files.begin(), files.end(), [this](const auto& file)
+	{
+		(*mStore)[file.first].second->content = Crypto::Base64ToBuffer(file.second);
+	});
+	return true;
+}
+
+bool PassManager::SerializeRecords(const StoreSnapshot& snapshot, std::vector<Vault::Record>& records)
+{
+	auto& store = *snapshot.store;
+	records.clear();
+	records.reserve(store.size());
+
+	for (auto& [name, pass] : store)
+	{
+		// sealed records are rewritten, so everything has to be loaded
+		{
+			std::lock_guard lock(loadMutex);
+			if (!Load(*pass))
+				return false;
+		}
+
+		Vault::Record record{};
+		record.type = (unsigned char)pass->type;
+		record.name = name;
+		record.content = ContentView(*pass);
+		records.push_back(record);
+	}
+	return true;
+}
+
+bool PassManager::Deserialize(const std::vector<Vault::Record>& records)
+{
+	for (auto& record : records)
+	{
+		if (record.type != (unsigned char)Type::Text && record.type != (unsigned char)Type::File)
+			return false;
+
+		auto pass = std::make_shared<Pass>();
+		pass->type = (Type)record.type;
+		pass->ref = record.ref;
+		mStore->push_back(std::make_pair(std::string(record.name), std::move(pass)));
+	}
+	return true;
+}
+
+void PassManager::Record(JournalOp op, int i, const std::string_view& name, Pass* pass)
+{
+	if (!mJournalValid)
+		return;
+
+	auto content = pass ? ContentView(*pass) : std::string_view();
+	auto type = pass ? pass->type : Type::Text;
+	auto entry = Crypto::AllocMemory(JournalEntrySize + name.size() + content.size());
+	if (!entry)
+	{
+		// change is lost from journal, next save has to rewrite whole vault
+		Logger::LogError("Could not record change in journal");
+		mJournalValid = false;
+		mJournal.clear();
+		return;
+	}
+
+	MemoryStream memory(entry, entry.size());
+	memory.Write((unsigned char)op);
+	memory.Write((unsigned int)i);
+	WriteEntry(memory, type, name, content);
+
+	mJournal.push_back(std::move(entry));
+}
+
+size_t PassManager::GetJournalSize(const StoreSnapshot& snapshot)
+{
+	size_t size = 0;
+	for (auto& entry : snapshot.journal)
+	{
+		size += entry.size();
+	}
+	return size;
+}
+
+void PassManager::ClearJournal()
+{
+	mJournal.clear();
+	mJournalValid = true;
+}
+
+bool PassManager::Replay(const std::vector<SecureArray>& journal)
+{
+	auto& store = *mStore;
+	for (auto& entry : journal)
+	{
+		// entries are prefixed with sequence number by Vault
+		MemoryStream memory((unsigned char*)&entry, entry.size());
+		memory.Seek(sizeof(uint64_t));
+
+		unsigned char op;
+		unsigned int i;
+		Type type;
+		std::string_view name, content;
+		if (!memory.Read(op) || !memory.Read(i) || !ReadEntry(memory, entry, type, name, content))
+			return false;
+
+		switch ((JournalOp)op)
+		{
+			case JournalOp::Add:
+			{
+				auto pass = std::make_shared<Pass>();
+				pass->type = type;
+				pass->content = CopyContent(content);
+				store.push_back(std::make_pair(std::string(name), std::move(pass)));
+				break;
+			}
+			case JournalOp::Change:
+			{
+				if (i >= store.size() || store[i].second->type != type)
+					return false;
+
+				auto pass = std::make_shared<Pass>();
+				pass->type = type;
+				pass->content = CopyContent(content);
+				store[i].second = std::move(pass);
+				break;
+			}
+			case JournalOp::Rename:
+			{
+				if (i >= store.size())
+					return false;
+
+				store[i].first = name;
+				break;
+			}
+			case JournalOp::Remove:
+			{
+				if (i >= store.size())
+					return false;
+
+				store.erase(store.begin() + i);
+				break;
 			}
+			default:
+				return false;
 		}
 	}
 	return true;
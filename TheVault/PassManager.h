@@ -1,16 +1,48 @@
 #pragma once
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
 #include "UnsavedState.h"
+#include "Vault.h"
+
+enum struct JournalOp : unsigned char;
+
+// entries are never edited in place, so a vector can be shared with a running save
+using StoreEntry = std::pair<std::string, std::shared_ptr<struct Pass>>;
+
+// store as it was when a save started, taken in O(1) on the ui thread
+struct StoreSnapshot
+{
+	std::shared_ptr<const std::vector<StoreEntry>> store;
+	std::shared_ptr<SecureArray> arena;
+	std::vector<SecureArray> journal; // changes up to the snapshot, handed back if the save fails
+	bool journalValid;
+	uint64_t version;
+};
 
 class PassManager
 {
 private:
-	std::vector<std::pair<std::string, struct Pass>> mStore;
+	std::shared_ptr<std::vector<StoreEntry>> mStore; // copied on first edit while a snapshot holds it
+	std::shared_ptr<SecureArray> mArena; // decrypted block, unchanged entries view into it
+	std::vector<SecureArray> mJournal;
+	bool mJournalValid;
+	uint64_t mVersion;
+	bool mSnapshotTaken; // one save at a time, its journal comes back on failure
+	std::mutex loadMutex; // sealed content is loaded by the ui and by a save, so are vault reads
+	Vault& vault;
 	UnsavedState& unsavedState;
 
+	bool Open(struct Pass& pass, SecureArray& scratch, std::string_view& content);
+	bool Load(struct Pass& pass);
+	bool InArena(const std::string_view& data);
+	std::vector<StoreEntry>& Edit();
+	bool DeserializeBinary(SecureSpan data, bool view);
+	void Record(JournalOp op, int i, const std::string_view& name, struct Pass* pass);
+
 public:
-	PassManager(UnsavedState& unsavedState);
+	PassManager(Vault& vault, UnsavedState& unsavedState);
 	~PassManager();
 	void Reset();
 
@@ -28,6 +60,18 @@ public:
 	void ChangeFile(int i, const std::wstring_view& file);
 	void ExtractFile(int i, const std::wstring_view& file);
 
-	std::string Serialize();
+	std::shared_ptr<StoreSnapshot> TakeSnapshot();
+	// ui thread, changes made after the snapshot stay unsaved
+	void FinishSnapshot(StoreSnapshot& snapshot, bool saved);
+
+	SecureArray Serialize(const StoreSnapshot& snapshot);
+	bool SerializeRecords(const StoreSnapshot& snapshot, std::vector<Vault::Record>& records);
+	static size_t GetJournalSize(const StoreSnapshot& snapshot);
+
 	bool Deserialize(const std::string_view& data);
+	bool Deserialize(SecureArray&& block);
+	bool Deserialize(const std::vector<Vault::Record>& records);
+
+	void ClearJournal();
+	bool Replay(const std::vector<SecureArray>& journal);
 };
@@ -0,0 +1,121 @@
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include <sodium.h>
+#include "SecureArena.h"
+
+constexpr size_t SlabSize = 64 * 1024;
+constexpr size_t ClassSizes[] = { 32, 64, 128, 256 };
+constexpr size_t ClassCount = sizeof(ClassSizes) / sizeof(ClassSizes[0]);
+
+const size_t SecureArena::MaxSize = ClassSizes[ClassCount - 1];
+
+struct Slab
+{
+	unsigned char* memory;
+	void* freeList; // wiped items link to each other through their first bytes
+	size_t next;    // items past this were never handed out
+	size_t used;
+};
+
+struct Arena
+{
+	std::mutex mutex;
+	std::vector<Slab> slabs[ClassCount];
+};
+
+static Arena& GetArena()
+{
+	// never destroyed, globals may free their secrets after statics are gone
+	static auto* arena = new Arena();
+	return *arena;
+}
+
+static size_t ClassOf(size_t size)
+{
+	size_t index = 0;
+	while (ClassSizes[index] < size)
+		++index;
+	return index;
+}
+
+void* SecureArena::Alloc(size_t size)
+{
+	if (size > MaxSize)
+		return nullptr;
+
+	auto index = ClassOf(size);
+	auto itemSize = ClassSizes[index];
+	auto& arena = GetArena();
+	std::lock_guard lock(arena.mutex);
+
+	auto& slabs = arena.slabs[index];
+	Slab* slab = nullptr;
+	for (auto& candidate : slabs)
+	{
+		if (candidate.freeList || candidate.next < SlabSize)
+		{
+			slab = &candidate;
+			break;
+		}
+	}
+
+	if (!slab)
+	{
+		auto* memory = (unsigned char*)sodium_malloc(SlabSize);
+		if (!memory)
+			return nullptr;
+		sodium_memzero(memory, SlabSize);
+		slab = &slabs.emplace_back(Slab{ memory, nullptr, 0, 0 });
+	}
+
+	void* item;
+	if (slab->freeList)
+	{
+		item = slab->freeList;
+		memcpy(&slab->freeList, item, sizeof(void*));
+		sodium_memzero(item, sizeof(void*));
+	}
+	else
+	{
+		item = slab->memory + slab->next;
+		slab->next += itemSize;
+	}
+
+	++slab->used;
+	return item;
+}
+
+void SecureArena::Free(void* ptr)
+{
+	if (!ptr)
+		return;
+
+	auto& arena = GetArena();
+	std::lock_guard lock(arena.mutex);
+
+	for (size_t index = 0; index < ClassCount; ++index)
+	{
+		auto& slabs = arena.slabs[index];
+		for (auto it = slabs.begin(); it != slabs.end(); ++it)
+		{
+			auto* item = (unsigned char*)ptr;
+			if (item < it->memory || item >= it->memory + SlabSize)
+				continue;
+
+			sodium_memzero(item, ClassSizes[index]);
+			--it->used;
+
+			if (it->used == 0 && slabs.size() > 1)
+			{
+				sodium_free(it->memory);
+				slabs.erase(it);
+				return;
+			}
+
+			memcpy(item, &it->freeList, sizeof(void*));
+			it->freeList = item;
+			return;
+		}
+	}
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include <cstddef>
+
+namespace SecureArena
+{
+	// requests up to this size share slabs, bigger ones need their own sodium_malloc
+	extern const size_t MaxSize;
+
+	void* Alloc(size_t size);
+	void Free(void* ptr);
+};
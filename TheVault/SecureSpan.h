@@ -0,0 +1,92 @@
+#pragma once
+#include <type_traits>
+#include "SecureArray.h"
+
+// borrowed view of secure memory, nothing is copied or freed
+template<typename T>
+class BasicSecureSpan
+{
+private:
+	T* mpData;
+	size_t mSize;
+
+public:
+	BasicSecureSpan() : mpData(nullptr), mSize(0)
+	{
+	}
+
+	BasicSecureSpan(std::nullptr_t) : mpData(nullptr), mSize(0)
+	{
+	}
+
+	BasicSecureSpan(T* pData, size_t n) : mpData(pData), mSize(n)
+	{
+	}
+
+	BasicSecureSpan(SecureArray& array) : mpData(array), mSize(array.size())
+	{
+	}
+
+	BasicSecureSpan(const SecureArray& array) requires std::is_const_v<T> : mpData(array), mSize(array.size())
+	{
+	}
+
+	template<typename U>
+	BasicSecureSpan(const BasicSecureSpan<U>& other) requires (std::is_const_v<T> && !std::is_const_v<U>) : mpData(other.data()), mSize(other.size())
+	{
+	}
+
+	auto& operator[](size_t i) const
+	{
+#if _DEBUG
+		if (i >= mSize)
+			throw std::out_of_range("Span index is out of range");
+
+		if (!mpData)
+			throw std::logic_error("Span pointer is null");
+#endif
+
+		return mpData[i];
+	}
+
+	operator T*() const
+	{
+		return mpData;
+	}
+
+	T* data() const
+	{
+		return mpData;
+	}
+
+	auto size() const
+	{
+		return mSize;
+	}
+
+	bool empty() const
+	{
+		return mSize == 0;
+	}
+
+	auto* str() const
+	{
+		if constexpr (std::is_const_v<T>)
+			return (const char*)mpData;
+		else
+			return (char*)mpData;
+	}
+
+	BasicSecureSpan subspan(size_t offset, size_t count) const
+	{
+#if _DEBUG
+		if (offset > mSize || count > mSize - offset)
+			throw std::out_of_range("Subspan is out of range");
+#endif
+
+		return BasicSecureSpan(mpData + offset, count);
+	}
+};
+
+using SecureSpan = BasicSecureSpan<const unsigned char>;
+using MutableSecureSpan = BasicSecureSpan<unsigned char>;
@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <bit>
+#include "TaskQueue.h"
+
+// cells are handed between threads by sequence numbers (bounded queue by Dmitry Vyukov)
+// sequence and waiter count are seq_cst, so a push to a full queue either sees the freed cell or the pop sees it waiting
+TaskQueue::TaskQueue(size_t capacity)
+{
+	capacity = std::bit_ceil(std::max<size_t>(capacity, 2));
+	mCells = std::make_unique<Cell[]>(capacity);
+	for (size_t i = 0; i < capacity; ++i)
+		mCells[i].sequence.store(i, std::memory_order_relaxed);
+
+	mMask = capacity - 1;
+	mTail = 0;
+	mHead = 0;
+	mSpace = 0;
+	mFullWaiters = 0;
+}
+
+bool TaskQueue::TryPush(Task& task)
+{
+	auto pos = mTail.load(std::memory_order_relaxed);
+	Cell* cell;
+	while (true)
+	{
+		cell = &mCells[pos & mMask];
+		auto sequence = cell->sequence.load();
+		auto diff = (intptr_t)sequence - (intptr_t)pos;
+		if (diff == 0)
+		{
+			if (mTail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0)
+			return false;
+		else
+			pos = mTail.load(std::memory_order_relaxed);
+	}
+
+	cell->enqueued = Clock::now();
+	cell->task = std::move(task);
+	cell->sequence.store(pos + 1);
+	return true;
+}
+
+void TaskQueue::Push(Task&& task)
+{
+	while (!TryPush(task))
+	{
+		auto key = mSpace.load();
+		mFullWaiters.fetch_add(1);
+		bool pushed = TryPush(task);
+		if (!pushed)
+			mSpace.wait(key);
+		mFullWaiters.fetch_sub(1);
+
+		if (pushed)
+			break;
+	}
+}
+
+bool TaskQueue::TryPop(Task& task, Clock::time_point& enqueued)
+{
+	auto& cell = mCells[mHead & mMask];
+	if (cell.sequence.load() != mHead + 1)
+		return false;
+
+	task = std::move(cell.task);
+	enqueued = cell.enqueued;
+	cell.sequence.store(mHead + mMask + 1);
+	++mHead;
+
+	if (mFullWaiters.load() != 0)
+	{
+		mSpace.fetch_add(1);
+		mSpace.notify_all();
+	}
+	return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include "KeeperTask.h"
+
+// bounded lock-free queue, any thread pushes and one consumer at a time pops
+// push to a full queue parks on an atomic (WaitOnAddress on windows) until a pop frees a cell
+class TaskQueue
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+private:
+	struct Cell
+	{
+		std::atomic_size_t sequence; // cell is free for push at index, full for pop at index + 1
+		Clock::time_point enqueued;
+		Task task;
+	};
+
+	std::unique_ptr<Cell[]> mCells;
+	size_t mMask;
+	alignas(64) std::atomic_size_t mTail;
+	alignas(64) size_t mHead; // next pop, consumer only
+	alignas(64) std::atomic_uint32_t mSpace;
+	std::atomic_uint32_t mFullWaiters;
+
+public:
+	explicit TaskQueue(size_t capacity);
+	TaskQueue(const TaskQueue&) = delete;
+	TaskQueue& operator=(const TaskQueue&) = delete;
+
+	void Push(Task&& task);
+	// task is left as it is when the queue is full
+	bool TryPush(Task& task);
+	bool TryPop(Task& task, Clock::time_point& enqueued);
+};
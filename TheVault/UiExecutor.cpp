@@ -0,0 +1,27 @@
+#include "UiExecutor.h"
+
+UiExecutor::UiExecutor()
+{
+	mReady.reserve(16);
+	mRunning.reserve(16);
+}
+
+void UiExecutor::Post(std::coroutine_handle<> handle)
+{
+	std::lock_guard lock(mutex);
+	mReady.push_back(handle);
+}
+
+void UiExecutor::Pump()
+{
+	{
+		std::lock_guard lock(mutex);
+		if (mReady.empty())
+			return;
+		mRunning.swap(mReady);
+	}
+
+	for (auto handle : mRunning)
+		handle.resume();
+	mRunning.clear();
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <coroutine>
+#include <mutex>
+#include <vector>
+
+// coroutines resumed on the ui thread, posted from any thread and run when the frame starts
+class UiExecutor
+{
+private:
+	std::mutex mutex;
+	std::vector<std::coroutine_handle<>> mReady; //protected by mutex
+	std::vector<std::coroutine_handle<>> mRunning; //used only in Pump
+
+public:
+	UiExecutor();
+	UiExecutor(const UiExecutor&) = delete;
+	UiExecutor& operator=(const UiExecutor&) = delete;
+
+	void Post(std::coroutine_handle<> handle);
+	// resumes everything posted so far, posts made meanwhile wait for the next pump
+	void Pump();
+};
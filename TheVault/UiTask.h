@@ -0,0 +1,104 @@
+#pragma once
+#include <coroutine>
+#include <optional>
+#include <utility>
+
+namespace UiTaskDetail
+{
+	template<typename R>
+	struct Result
+	{
+		std::optional<R> value;
+
+		void return_value(R result) { value.emplace(std::move(result)); }
+		R Take() { return std::move(*value); }
+	};
+
+	template<>
+	struct Result<void>
+	{
+		void return_void() {}
+		void Take() {}
+	};
+};
+
+// coroutine of the ui thread, starts right away and runs on its own if the task object is dropped
+template<typename T = void>
+class UiTask
+{
+public:
+	struct promise_type : UiTaskDetail::Result<T>
+	{
+		std::coroutine_handle<> continuation;
+		bool detached = false;
+
+		struct FinalAwaiter
+		{
+			bool await_ready() noexcept { return false; }
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+			{
+				auto& promise = handle.promise();
+				if (promise.continuation)
+					return promise.continuation;
+				if (promise.detached)
+					handle.destroy();
+				return std::noop_coroutine();
+			}
+			void await_resume() noexcept {}
+		};
+
+		UiTask get_return_object() { return UiTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		FinalAwaiter final_suspend() noexcept { return {}; }
+		void unhandled_exception() { throw; }
+	};
+
+private:
+	std::coroutine_handle<promise_type> handle;
+
+	explicit UiTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+public:
+	UiTask() : handle(nullptr) {}
+	UiTask(const UiTask&) = delete;
+	UiTask& operator=(const UiTask&) = delete;
+	UiTask(UiTask&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+	UiTask& operator=(UiTask&& other) noexcept
+	{
+		if (this != &other)
+		{
+			reset();
+			handle = std::exchange(other.handle, nullptr);
+		}
+		return *this;
+	}
+	~UiTask() { reset(); }
+
+	void reset()
+	{
+		if (!handle)
+			return;
+		// unfinished coroutine frees itself at the end
+		if (handle.done())
+			handle.destroy();
+		else
+			handle.promise().detached = true;
+		handle = nullptr;
+	}
+
+	bool valid() const { return handle != nullptr; }
+	bool done() const { return !handle || handle.done(); }
+
+	auto operator co_await() &&
+	{
+		struct Awaiter
+		{
+			std::coroutine_handle<promise_type> handle;
+
+			bool await_ready() { return handle.done(); }
+			void await_suspend(std::coroutine_handle<> awaiter) { handle.promise().continuation = awaiter; }
+			T await_resume() { return handle.promise().Take(); }
+		};
+		return Awaiter{ handle };
+	}
+};
@@ -1,9 +1,43 @@
+#include <algorithm>
+#include <atomic>
+#include <execution>
+#include <numeric>
 #include "Vault.h"
 #include "Crypto.h"
+#include "WinApi.h"
 #include "Files/Container.h"
 #include "Files/MemoryStream.h"
 
+// framed without Container, so journal can be appended behind the data
 struct VaultHeader
+{
+	static constexpr unsigned int Magic = 0x544C5654; // TVLT
+	static constexpr unsigned short Version = 5;
+
+	// everything up to DataSize is bound to sealed data as associated data
+	unsigned int FileMagic;
+	unsigned short FileVersion;
+	unsigned char LockSteps;
+	unsigned char Layout;
+	unsigned char Cipher;
+	unsigned char KdfLanes;
+	unsigned char Reserved[2];
+	unsigned int ChunkSize;
+	unsigned int KdfPasses;
+	unsigned int KdfMemory; // KiB
+	unsigned char KeySalt[16];
+	unsigned char LockNonce[24];
+	unsigned char FirstKey[32];
+
+	// known only once data is sealed
+	uint64_t DataSize;
+	uint64_t JournalId;
+};
+
+constexpr size_t BoundHeaderSize = offsetof(VaultHeader, DataSize);
+
+// block sealed as single secretbox, upgraded to current version on save
+struct VaultHeaderV1
 {
 	static constexpr unsigned short Magic = 0x5645;
 	static constexpr unsigned short Version = 1;
@@ -14,8 +48,61 @@ struct VaultHeader
 	unsigned char FirstKey[32];
 };
 
+template<typename Header>
+static bool ReadHeader(const std::wstring_view& file, Header& header, unsigned int& dataSize)
+{
+	FileReader stream;
+	if (!stream.Open(file))
+		return false;
+
+	return Container::Open<Header>(stream, header, dataSize) && dataSize != 0;
+}
+
+static bool ReadFramedHeader(const MappedFile& mapping, VaultHeader& header)
+{
+	if (mapping.size() < sizeof(header))
+		return false;
+
+	memcpy(&header, mapping.data(), sizeof(header));
+	return header.FileVersion == VaultHeader::Version;
+}
+
+static bool ReadLegacyHeader(const std::wstring_view& file, VaultHeader& header)
+{
+	unsigned int dataSize;
+	VaultHeaderV1 v1;
+	if (!ReadHeader(file, v1, dataSize))
+		return false;
+
+	header = {};
+	header.LockSteps = v1.LockSteps;
+	memcpy(header.KeySalt, v1.KeySalt, sizeof(header.KeySalt));
+	memcpy(header.LockNonce, v1.LockNonce, sizeof(header.LockNonce));
+	memcpy(header.FirstKey, v1.FirstKey, sizeof(header.FirstKey));
+	header.DataSize = dataSize;
+	return true;
+}
+
+static const char IndexKeyContext[] = "VaultIdx";
+static const char RecordKeyContext[] = "VaultRec";
+static const char JournalKeyContext[] = "VaultJrn";
+
+// journal is compacted into a full save once it outgrows half of the data or this size
+constexpr uint64_t MinJournalLimit = 1024 * 1024;
+
 Vault::Vault()
 {
+	mChunkSize = (unsigned int)Crypto::StreamChunkSize;
+	mLayout = Layout::Records;
+	mCipher = Crypto::Cipher::XChaCha20Poly1305;
+	mNextCipher = mCipher;
+	mKdfParams = Crypto::DefaultKdfParams();
+	mDataSize = 0;
+	mJournalId = 0;
+	mJournalStart = 0;
+	mJournalEnd = 0;
+	mJournalSeq = 0;
+
 	if (sizeof(VaultHeader::KeySalt) != Crypto::PwSaltSize)
 		throw std::exception("KeySalt size mismatch");
 
@@ -46,9 +133,17 @@ bool Vault::Initialize()
 
 void Vault::Reset()
 {
-	mData.reset();
-	mLockSteps.clear();
-	mEBlock.reset();
+	ResetCache();
+	mChunkSize = (unsigned int)Crypto::StreamChunkSize;
+	mLayout = Layout::Records;
+	mCipher = Crypto::Cipher::XChaCha20Poly1305;
+	mNextCipher = mCipher;
+	mKdfParams = Crypto::DefaultKdfParams();
+	mDataSize = 0;
+	mJournalId = 0;
+	mJournalStart = 0;
+	mJournalEnd = 0;
+	mJournalSeq = 0;
 
 	Crypto::ZeroMemory(mKeySalt);
 	Crypto::ZeroMemory(mLockNonce);
@@ -57,42 +152,85 @@ void Vault::Reset()
 
 void Vault::ResetCache()
 {
-	mData.reset();
+	mRecords.clear();
+	mIndex.reset();
+	mRecordKey.reset();
+	mJournal.clear();
+	mJournalEntries.clear();
 	mLockSteps.clear();
 	mEBlock.reset();
+	mFile.Close();
 }
 
 bool Vault::Open(const std::wstring_view& file)
 {
-	FileReader stream;
-	if (!stream.Open(file))
+	MappedFile mapping;
+	if (!mapping.Open(file))
 		return false;
-	
-	VaultHeader header;
-	unsigned int dataSize;
 
-	if (!Container::Open<VaultHeader>(stream, header, dataSize) || dataSize == 0)
-		return false;
+	// header, steps, block and journal are all parsed in place
+	VaultHeader header{};
+	unsigned int magic = 0;
+	if (mapping.size() >= sizeof(magic))
+		memcpy(&magic, mapping.data(), sizeof(magic));
 
-	if (header.LockSteps == 0)
-		return false;
+	uint64_t dataStart;
+	std::string headerData;
+	if (magic == VaultHeader::Magic)
+	{
+		if (!ReadFramedHeader(mapping, header))
+			return false;
 
-	auto data = Crypto::AllocMemory(dataSize);
-	if (!data)
+		if (header.ChunkSize == 0 || header.Layout > (unsigned char)Layout::Records)
+			return false;
+
+		if (header.Cipher == (unsigned char)Crypto::Cipher::SecretBox || header.Cipher > (unsigned char)Crypto::Cipher::Aes256Gcm)
+			return false;
+
+		dataStart = sizeof(header);
+		if (header.DataSize == 0 || header.DataSize > mapping.size() - dataStart)
+			return false;
+
+		headerData.assign((const char*)mapping.data(), BoundHeaderSize);
+	}
+	else
+	{
+		if (!ReadLegacyHeader(file, header) || mapping.size() < header.DataSize)
+			return false;
+
+		// container payload is the tail of the file, there is no journal
+		dataStart = mapping.size() - header.DataSize;
+		header.JournalId = 0;
+		header.Cipher = (unsigned char)Crypto::Cipher::SecretBox;
+
+		auto kdf = Crypto::DefaultKdfParams();
+		header.KdfLanes = 1;
+		header.KdfPasses = kdf.passes;
+		header.KdfMemory = kdf.memory;
+	}
+
+	// costs are authenticated only after the key is derived with them
+	Crypto::KdfParams kdf{ header.KdfPasses, header.KdfMemory, header.KdfLanes };
+	if (!Crypto::IsKdfParamsValid(kdf))
 		return false;
 
-	auto ref = FixedArray<unsigned char>::CreateArrayRef(data, data.size());
-	if (!stream.Read(ref))
+	auto cipher = (Crypto::Cipher)header.Cipher;
+	auto recordOverhead = Crypto::GetRecordOverhead(cipher);
+
+	if (header.LockSteps == 0)
 		return false;
 
+	auto* data = mapping.data() + dataStart;
+	auto dataSize = (size_t)header.DataSize;
+
 	std::vector<SecureArray> lockSteps;
 	lockSteps.reserve(header.LockSteps);
 
-	MemoryStream memory(data, data.size());
+	MemoryStream memory(data, dataSize);
 	for (unsigned char i = 0; i < header.LockSteps; ++i)
 	{
 		unsigned int size;
-		if (!memory.Read(size) || size == 0)
+		if (!memory.Read(size) || size == 0 || (memory.GetPos() + size) > dataSize)
 			return false;
 
 		auto mem = SecureArray::Wrap(data + memory.GetPos(), size, nullptr);
@@ -101,13 +239,44 @@ bool Vault::Open(const std::wstring_view& file)
 		lockSteps.push_back(std::move(mem));
 	}
 
-	auto eblock = SecureArray::Wrap(data + memory.GetPos(), data.size() - memory.GetPos(), nullptr);
-	if ((memory.GetPos() + eblock.size()) > data.size())
+	if (memory.GetPos() >= dataSize)
 		return false;
+	auto eblock = SecureArray::Wrap(data + memory.GetPos(), dataSize - memory.GetPos(), nullptr);
+
+	// journal entries are only framed here, torn tail is dropped
+	std::vector<SecureArray> journal;
+	uint64_t journalStart = dataStart + dataSize;
+	uint64_t journalEnd = journalStart;
+	if (header.JournalId != 0)
+	{
+		while (mapping.size() - journalEnd >= sizeof(unsigned int))
+		{
+			unsigned int size;
+			memcpy(&size, mapping.data() + journalEnd, sizeof(size));
+			if (size < recordOverhead || size > mapping.size() - journalEnd - sizeof(size))
+				break;
+
+			journal.push_back(SecureArray::Wrap(mapping.data() + journalEnd + sizeof(size), size, nullptr));
+			journalEnd += sizeof(size) + size;
+		}
+	}
 
-	mData = std::move(data);
+	ResetCache();
+	mFile = std::move(mapping);
 	mLockSteps = std::move(lockSteps);
 	mEBlock = std::move(eblock);
+	mJournalEntries = std::move(journal);
+	mChunkSize = header.ChunkSize;
+	mLayout = (Layout)header.Layout;
+	mCipher = cipher;
+	mNextCipher = cipher == Crypto::Cipher::SecretBox ? Crypto::Cipher::XChaCha20Poly1305 : cipher;
+	mHeaderData = std::move(headerData);
+	mKdfParams = kdf;
+	mDataSize = dataSize;
+	mJournalId = header.JournalId;
+	mJournalStart = header.JournalId != 0 ? journalStart : 0;
+	mJournalEnd = header.JournalId != 0 ? journalEnd : 0;
+	mJournalSeq = 0;
 
 	memcpy(mKeySalt, header.KeySalt, mKeySalt.size());
 	memcpy(mLockNonce, header.LockNonce, mLockNonce.size());
@@ -115,19 +284,64 @@ bool Vault::Open(const std::wstring_view& file)
 	return true;
 }
 
-bool Vault::Place(const std::wstring_view& file)
+void Vault::FillHeader(VaultHeader& header)
 {
-	FileWriter stream;
-	if (!stream.Open(file))
-		return false;
-
-	VaultHeader header{};
+	header.FileMagic = VaultHeader::Magic;
+	header.FileVersion = VaultHeader::Version;
 	header.LockSteps = (unsigned char)mLockSteps.size();
+	header.Layout = (unsigned char)mLayout;
+	header.Cipher = (unsigned char)mCipher;
+	header.KdfLanes = (unsigned char)mKdfParams.lanes;
+	header.KdfPasses = mKdfParams.passes;
+	header.KdfMemory = mKdfParams.memory;
+	header.ChunkSize = mChunkSize;
 	memcpy(header.KeySalt, mKeySalt, mKeySalt.size());
 	memcpy(header.LockNonce, mLockNonce, mLockNonce.size());
 	memcpy(header.FirstKey, mFirstKey, mFirstKey.size());
+}
+
+bool Vault::PrepareSeal()
+{
+	// aes is used only when asked for, a vault sealed with it can't be opened without aes-ni
+	mCipher = mNextCipher;
+	if (mCipher == Crypto::Cipher::SecretBox || !Crypto::IsCipherAvailable(mCipher))
+		mCipher = Crypto::Cipher::XChaCha20Poly1305;
+	mNextCipher = mCipher;
+
+	// legacy single-chest vaults are written back in chunked format
+	if (mChunkSize == 0)
+		mChunkSize = (unsigned int)Crypto::StreamChunkSize;
+
+	// header written by Place has to match what is bound now
+	VaultHeader header{};
+	FillHeader(header);
+	mHeaderData.assign((const char*)&header, BoundHeaderSize);
+	return true;
+}
 
-	if (!Container::BeginWrite<VaultHeader>(stream, header))
+bool Vault::Place(const std::wstring_view& file)
+{
+	uint64_t dataSize = mEBlock.size();
+	for (auto& step : mLockSteps)
+	{
+		dataSize += sizeof(unsigned int) + step.size();
+	}
+
+	VaultHeader header{};
+	FillHeader(header);
+	header.DataSize = dataSize;
+
+	// new id invalidates journal entries sealed for previous file
+	do
+	{
+		header.JournalId = Crypto::RandomNumber();
+	} while (header.JournalId == 0);
+
+	FileWriter stream;
+	if (!stream.Open(file))
+		return false;
+
+	if (!stream.Write(header))
 		return false;
 
 	for (auto& step : mLockSteps)
@@ -140,34 +354,143 @@ bool Vault::Place(const std::wstring_view& file)
 			return false;
 	}
 
-	if (!stream.Write(mEBlock, (uint32_t)mEBlock.size()))
+	// writer takes 32-bit sizes, block may be larger
+	for (size_t pos = 0; pos < mEBlock.size(); pos += Crypto::StreamChunkSize)
+	{
+		auto chunk = std::min(mEBlock.size() - pos, Crypto::StreamChunkSize);
+		if (!stream.Write(mEBlock + pos, (unsigned int)chunk))
+			return false;
+	}
+
+	mDataSize = dataSize;
+	mJournalId = header.JournalId;
+	mJournalStart = sizeof(header) + dataSize;
+	mJournalEnd = mJournalStart;
+	mJournalSeq = 0;
+	return true;
+}
+
+bool Vault::OpenJournal(SecureSpan key)
+{
+	if (mJournalEntries.empty())
+		return true;
+
+	auto journalKey = Crypto::DeriveKey(key, mJournalId, JournalKeyContext);
+	if (!journalKey)
 		return false;
 
-	if (!Container::EndWrite<VaultHeader>(stream))
+	std::vector<SecureArray> journal;
+	journal.reserve(mJournalEntries.size());
+
+	uint64_t end = mJournalStart;
+	for (auto& entry : mJournalEntries)
+	{
+		// entry that does not open or breaks the sequence ends the journal, next append overwrites it
+		SecureArray plain;
+		uint64_t seq;
+		if (!Crypto::OpenRecord(entry, entry.size(), journalKey, plain, mCipher, mHeaderData) || plain.size() <= sizeof(seq))
+			break;
+
+		memcpy(&seq, plain, sizeof(seq));
+		if (seq != journal.size())
+			break;
+
+		journal.push_back(std::move(plain));
+		end += sizeof(unsigned int) + entry.size();
+	}
+
+	mJournalEntries.clear();
+	mJournal = std::move(journal);
+	mJournalEnd = end;
+	mJournalSeq = mJournal.size();
+	return true;
+}
+
+std::vector<SecureArray> Vault::TakeJournal()
+{
+	return std::move(mJournal);
+}
+
+bool Vault::CanAppend(size_t size)
+{
+	if (mJournalId == 0)
+		return false;
+
+	auto limit = std::max(mDataSize / 2, MinJournalLimit);
+	return (mJournalEnd - mJournalStart) + size <= limit;
+}
+
+bool Vault::AppendJournal(const std::wstring_view& file, SecureSpan key, const std::vector<SecureArray>& entries)
+{
+	if (!key || mJournalId == 0)
+		return false;
+
+	if (entries.empty())
+		return true;
+
+	size_t size = 0;
+	for (auto& entry : entries)
+	{
+		size += sizeof(unsigned int) + Crypto::GetRecordOverhead(mCipher) + sizeof(uint64_t) + entry.size();
+	}
+
+	auto journalKey = Crypto::DeriveKey(key, mJournalId, JournalKeyContext);
+	auto buffer = Crypto::AllocMemory(size);
+	if (!journalKey || !buffer)
+		return false;
+
+	MemoryStream memory(buffer, buffer.size());
+	auto seq = mJournalSeq;
+	for (auto& entry : entries)
+	{
+		auto plain = Crypto::AllocMemory(sizeof(seq) + entry.size());
+		if (!plain)
+			return false;
+
+		memcpy(plain, &seq, sizeof(seq));
+		memcpy(plain + sizeof(seq), entry, entry.size());
+
+		auto sealedSize = (unsigned int)(Crypto::GetRecordOverhead(mCipher) + plain.size());
+		if (!memory.Write(sealedSize))
+			return false;
+
+		auto content = std::string_view(plain.str(), plain.size());
+		if (!Crypto::CreateRecord(content, journalKey, buffer + memory.GetPos(), mCipher, mHeaderData))
+			return false;
+		memory.Seek(sealedSize);
+		++seq;
+	}
+
+	// single write at the end of valid journal, flushed once
+	if (!WinApi::WriteFileAt(file, mJournalEnd, buffer, buffer.size()))
 		return false;
+
+	mJournalEnd += buffer.size();
+	mJournalSeq = seq;
 	return true;
 }
 
-SecureArray Vault::CreateKey(const std::string_view& password)
+SecureArray Vault::CreateKey(const std::string_view& password, std::stop_token stop, Argon2::Workspace* workspace)
 {
-	return Crypto::HashPassword(password, mKeySalt);
+	return Crypto::HashPassword(password, mKeySalt, mKdfParams, stop, workspace);
 }
 
-SecureArray Vault::CreateMasterKey(const std::vector<SecureArray>& keys, const SecureArray& lastKey)
+SecureArray Vault::CreateMasterKey(const std::vector<SecureArray>& keys, SecureSpan lastKey)
 {
-	size_t size = lastKey.size();
+	// first key stays in the vault, callers pass only password keys
+	size_t size = mFirstKey.size() + lastKey.size();
 	for (auto& key : keys)
 	{
 		size += key.size();
 	}
-	if (size == 0)
-		return nullptr;
 
 	auto master = Crypto::AllocMemory(size);
 	if (!master)
 		return nullptr;
 
 	MemoryStream stream(master, master.size());
+	if (stream.Write(mFirstKey, mFirstKey.size()) != mFirstKey.size())
+		return nullptr;
 	for (auto& key : keys)
 	{
 		if (stream.Write(key, key.size()) != key.size())
@@ -180,7 +503,7 @@ SecureArray Vault::CreateMasterKey(const std::vector<SecureArray>& keys, const S
 	return Crypto::HashData(data);
 }
 
-bool Vault::UnlockStep(const SecureArray& key, int i, SecureArray& plain)
+bool Vault::UnlockStep(SecureSpan key, int i, SecureArray& plain)
 {
 	if (i >= mLockSteps.size() || i < 0 || !key)
 		return false;
@@ -202,12 +525,110 @@ bool Vault::UnlockStep(const SecureArray& key, int i, SecureArray& plain)
 	return true;
 }
 
-bool Vault::UnlockBlock(const SecureArray& key)
+bool Vault::UnlockBlock(SecureSpan key, std::stop_token stop)
+{
+	if (!key || !mEBlock)
+		return false;
+
+	if (mLayout == Layout::Records)
+	{
+		if (!UnlockIndex(key))
+			return false;
+	}
+	else
+	{
+		SecureArray block;
+		if (mChunkSize == 0)
+		{
+			// block stays in the mapped file until now - copy it to secure memory only for decryption
+			block = Crypto::CopyMemory(mEBlock);
+			if (!block)
+				return false;
+
+			if (!Crypto::OpenChestInPlace(block, key, mLockNonce))
+				return false;
+		}
+		else
+		{
+			block = Crypto::OpenSegmentedChest(mEBlock, key, mChunkSize, mCipher, mHeaderData, stop);
+			if (!block)
+				return false;
+		}
+
+		mEBlock = std::move(block);
+	}
+
+	return OpenJournal(key);
+}
+
+// records block: u64 sealed index size, sealed index, sealed records
+// index entry: u8 type, u64 id, u64 offset, u64 size, u16 name size, name
+constexpr size_t IndexEntrySize = sizeof(unsigned char) + sizeof(uint64_t) * 3 + sizeof(unsigned short);
+
+bool Vault::UnlockIndex(SecureSpan key)
 {
+	uint64_t indexSize;
+	if (mEBlock.size() < sizeof(indexSize))
+		return false;
+
+	memcpy(&indexSize, mEBlock, sizeof(indexSize));
+	if (indexSize > mEBlock.size() - sizeof(indexSize))
+		return false;
+
+	auto indexKey = Crypto::DeriveKey(key, 0, IndexKeyContext);
+	if (!indexKey)
+		return false;
+
+	SecureArray index;
+	if (!Crypto::OpenRecord(mEBlock + sizeof(indexSize), (size_t)indexSize, indexKey, index, mCipher, mHeaderData) || !index)
+		return false;
+
+	MemoryStream memory(index, index.size());
+	unsigned int count;
+	if (!memory.Read(count))
+		return false;
+
+	std::vector<Record> records;
+	records.reserve(count);
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		Record record{};
+		unsigned short nameSize;
+		if (!memory.Read(record.type) || !memory.Read(record.ref.id) || !memory.Read(record.ref.offset) || !memory.Read(record.ref.size) || !memory.Read(nameSize))
+			return false;
+
+		if ((memory.GetPos() + nameSize) > index.size())
+			return false;
+		record.name = std::string_view(index.str() + memory.GetPos(), nameSize);
+		memory.Seek(nameSize);
+
+		if (record.ref.size < Crypto::GetRecordOverhead(mCipher) || record.ref.offset > mEBlock.size() || record.ref.size > mEBlock.size() - record.ref.offset)
+			return false;
+
+		records.push_back(record);
+	}
+
+	auto recordKey = Crypto::CopyMemory(key);
+	if (!recordKey)
+		return false;
+
+	// sealed records stay in the mapped file and are opened one by one
+	mIndex = std::move(index);
+	mRecordKey = std::move(recordKey);
+	mRecords = std::move(records);
+	return true;
+}
+
+bool Vault::OpenRecord(const RecordRef& ref, SecureArray& content)
+{
+	if (!mRecordKey || !mEBlock || ref.offset > mEBlock.size() || ref.size > mEBlock.size() - ref.offset)
+		return false;
+
+	auto key = Crypto::DeriveKey(mRecordKey, ref.id, RecordKeyContext);
 	if (!key)
 		return false;
 
-	return Crypto::OpenChestInPlace(mEBlock, key, mLockNonce);
+	return Crypto::OpenRecord(mEBlock + ref.offset, (size_t)ref.size, key, content, mCipher, mHeaderData);
 }
 
 void Vault::GenerateNew()
@@ -216,9 +637,11 @@ void Vault::GenerateNew()
 	Crypto::FillRandomBytes(mLockNonce);
 	Crypto::FillRandomBytes(mFirstKey);
 
-	mData = {};
+	// every key is derived again, so lanes can follow this machine
+	mKdfParams.lanes = Crypto::DefaultKdfLanes();
+
+	// sealed block stays - records may still be opened from it until next save
 	mLockSteps.clear();
-	mEBlock = {};
 }
 
 void Vault::ResetSteps()
@@ -226,7 +649,7 @@ void Vault::ResetSteps()
 	mLockSteps.clear();
 }
 
-bool Vault::AddStep(const SecureArray& plain, const SecureArray& key)
+bool Vault::AddStep(SecureSpan plain, SecureSpan key)
 {
 	if (!key || !plain)
 		return false;
@@ -249,11 +672,92 @@ bool Vault::AddStep(const SecureArray& plain, const SecureArray& key)
 	return true;
 }
 
-bool Vault::LockBlock(const SecureArray& key, const std::string_view& content)
+bool Vault::LockBlock(SecureSpan key, const std::string_view& content, std::stop_token stop)
 {
-	if (!key || content.empty())
+	if (!key || content.empty() || !PrepareSeal())
 		return false;
 
-	mEBlock = Crypto::CreateChest(content, key, mLockNonce);
+	mEBlock = Crypto::CreateSegmentedChest(content, key, mChunkSize, mCipher, mHeaderData, stop);
 	return mEBlock;
 }
+
+bool Vault::LockRecords(SecureSpan key, const std::vector<Record>& records, std::stop_token stop)
+{
+	if (!key || records.size() > UINT32_MAX || !PrepareSeal())
+		return false;
+
+	auto recordOverhead = Crypto::GetRecordOverhead(mCipher);
+	size_t indexSize = sizeof(unsigned int);
+	size_t recordsSize = 0;
+	for (auto& record : records)
+	{
+		if (record.name.size() > USHRT_MAX)
+			return false;
+
+		indexSize += IndexEntrySize + record.name.size();
+		recordsSize += recordOverhead + record.content.size();
+	}
+
+	auto index = Crypto::AllocMemory(indexSize);
+	auto block = Crypto::AllocMemory(sizeof(uint64_t) + indexSize + recordOverhead + recordsSize);
+	auto indexKey = Crypto::DeriveKey(key, 0, IndexKeyContext);
+	if (!index || !block || !indexKey)
+		return false;
+
+	MemoryStream memory(index, index.size());
+	if (!memory.Write((unsigned int)records.size()))
+		return false;
+
+	std::vector<uint64_t> offsets;
+	offsets.reserve(records.size());
+
+	uint64_t offset = sizeof(uint64_t) + indexSize + recordOverhead;
+	uint64_t id = 0;
+	for (auto& record : records)
+	{
+		// id 0 is reserved for index key
+		++id;
+		offsets.push_back(offset);
+
+		auto size = (uint64_t)(recordOverhead + record.content.size());
+		auto nameSize = (unsigned short)record.name.size();
+		if (!memory.Write(record.type) || !memory.Write(id) || !memory.Write(offset) || !memory.Write(size) || !memory.Write(nameSize))
+			return false;
+		if (memory.Write(record.name.data(), nameSize) != nameSize)
+			return false;
+
+		offset += size;
+	}
+
+	// records have own keys and places in the block, so they are sealed in parallel
+	// by index, parallel algorithms may hand out copies of elements
+	std::vector<size_t> tasks(records.size());
+	std::iota(tasks.begin(), tasks.end(), 0);
+
+	std::atomic_bool sealed = true;
+	std::for_each(std::execution::par, tasks.begin(), tasks.end(), [&](size_t i)
+	{
+		if (!sealed || stop.stop_requested())
+		{
+			sealed = false;
+			return;
+		}
+
+		auto recordKey = Crypto::DeriveKey(key, i + 1, RecordKeyContext);
+		if (!recordKey || !Crypto::CreateRecord(records[i].content, recordKey, block + offsets[i], mCipher, mHeaderData))
+			sealed = false;
+	});
+
+	if (!sealed)
+		return false;
+
+	uint64_t sealedSize = recordOverhead + indexSize;
+	memcpy(block, &sealedSize, sizeof(sealedSize));
+
+	auto content = std::string_view(index.str(), index.size());
+	if (!Crypto::CreateRecord(content, indexKey, block + sizeof(sealedSize), mCipher, mHeaderData))
+		return false;
+
+	mEBlock = std::move(block);
+	return true;
+}
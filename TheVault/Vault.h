@@ -2,11 +2,49 @@
 #include <vector>
 #include <string>
 #include "SecureArray.h"
+#include "MappedFile.h"
+#include "Crypto.h"
 
 class Vault
 {
+public:
+	enum class Layout : unsigned char
+	{
+		Stream, // whole store sealed as one chunked block
+		Records, // sealed index with independently sealed entries
+	};
+
+	struct RecordRef
+	{
+		uint64_t id;
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	struct Record
+	{
+		unsigned char type;
+		std::string_view name;
+		std::string_view content; // used only when locking
+		RecordRef ref; // used only when unlocked
+	};
+
 private:
-	SecureArray mData;
+	MappedFile mFile;
+	unsigned int mChunkSize;
+	Layout mLayout;
+	Crypto::Cipher mCipher; // cipher of sealed data
+	Crypto::Cipher mNextCipher; // used by next full save
+	std::string mHeaderData; // header part bound to sealed data
+	Crypto::KdfParams mKdfParams;
+	uint64_t mDataSize;
+
+	uint64_t mJournalId;
+	uint64_t mJournalStart;
+	uint64_t mJournalEnd;
+	uint64_t mJournalSeq;
+	std::vector<SecureArray> mJournalEntries;
+	std::vector<SecureArray> mJournal;
 
 	SecureArray mKeySalt;
 	SecureArray mLockNonce;
@@ -15,6 +53,15 @@ private:
 	std::vector<SecureArray> mLockSteps;
 	SecureArray mEBlock;
 
+	SecureArray mIndex;
+	SecureArray mRecordKey;
+	std::vector<Record> mRecords;
+
+	void FillHeader(struct VaultHeader& header);
+	bool PrepareSeal();
+	bool UnlockIndex(SecureSpan key);
+	bool OpenJournal(SecureSpan key);
+
 public:
 	Vault();
 	~Vault();
@@ -27,15 +74,31 @@ public:
 
 	size_t GetLockSteps() { return mLockSteps.size(); }
 	SecureArray& GetBlock() { return mEBlock; }
-	SecureArray& GetFirstKey() { return mFirstKey; }
+	SecureArray TakeBlock() { return std::move(mEBlock); }
+	SecureSpan GetFirstKey() const { return mFirstKey; }
+	const std::vector<Record>& GetRecords() { return mRecords; }
+	bool HasRecords() { return mRecordKey; }
+	Layout GetLayout() { return mLayout; }
+	void SetLayout(Layout layout) { mLayout = layout; }
+	Crypto::Cipher GetCipher() { return mNextCipher; }
+	void SetCipher(Crypto::Cipher cipher) { mNextCipher = cipher; }
+	const Crypto::KdfParams& GetKdfParams() { return mKdfParams; }
+	void SetKdfParams(const Crypto::KdfParams& params) { mKdfParams = params; }
+	size_t GetContentSize(const RecordRef& ref) { return (size_t)ref.size - Crypto::GetRecordOverhead(mCipher); }
 
-	SecureArray CreateKey(const std::string_view& password);
-	SecureArray CreateMasterKey(const std::vector<SecureArray>& keys, const SecureArray& lastKey);
-	bool UnlockStep(const SecureArray& key, int i, SecureArray& plain);
-	bool UnlockBlock(const SecureArray& key);
+	SecureArray CreateKey(const std::string_view& password, std::stop_token stop = {}, Argon2::Workspace* workspace = nullptr);
+	SecureArray CreateMasterKey(const std::vector<SecureArray>& keys, SecureSpan lastKey);
+	bool UnlockStep(SecureSpan key, int i, SecureArray& plain);
+	bool UnlockBlock(SecureSpan key, std::stop_token stop = {});
+	bool OpenRecord(const RecordRef& ref, SecureArray& content);
 
 	void GenerateNew();
 	void ResetSteps();
-	bool AddStep(const SecureArray& plain, const SecureArray& key);
-	bool LockBlock(const SecureArray& key, const std::string_view& content);
+	bool AddStep(SecureSpan plain, SecureSpan key);
+	bool LockBlock(SecureSpan key, const std::string_view& content, std::stop_token stop = {});
+	bool LockRecords(SecureSpan key, const std::vector<Record>& records, std::stop_token stop = {});
+
+	std::vector<SecureArray> TakeJournal();
+	bool CanAppend(size_t size);
+	bool AppendJournal(const std::wstring_view& file, SecureSpan key, const std::vector<SecureArray>& entries);
 };
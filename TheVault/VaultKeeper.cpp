@@ -1,29 +1,19 @@
-#include <optional>
 #include "VaultKeeper.h"
-#include "Game.h"
+#include "Vault.h"
+#include "PassManager.h"
+#include "UnsavedState.h"
+#include "GUI/Objects/MainWindow.h"
 #include "Crypto.h"
 #include "Engine/Logger.h"
 #include "Utility/StringUtils.h"
 
-extern Game game;
 using Future = VaultKeeper::Future;
-using TaskRet = MainWindow::TaskRet;
 
-struct Task
-{
-	std::function<uint64_t()> func;
-	std::function<uint64_t(const SecureArray&)> func2;
-	std::function<uint64_t(const std::wstring&)> func3;
-	std::function<uint64_t(const std::string&)> func4;
-	std::promise<uint64_t> promise;
-	SecureArray arg;
-	std::optional<std::wstring> arg2;
-	std::optional<std::string> arg3;
-};
-
-VaultKeeper::VaultKeeper()
+VaultKeeper::VaultKeeper(Vault& vault, PassManager& passMgr, UnsavedState& unsavedState, MainWindow& window, UiExecutor& executor, WorkerPool& pool, KdfScheduler& kdfScheduler)
+	: Strand(pool, 64), vault(vault), passMgr(passMgr), unsavedState(unsavedState), window(window), executor(executor), mKdfScheduler(kdfScheduler)
 {
 	file = L"vault.bin";
+	mLockChanged = false;
 	mHints.reserve(16);
 	mKeyChain.reserve(16);
 }
@@ -33,172 +23,168 @@ VaultKeeper::~VaultKeeper()
 	Shutdown();
 }
 
-void VaultKeeper::Init()
-{
-	if (thread.joinable())
-		return;
-	using namespace std::placeholders;
-	thread = std::jthread(std::bind(&VaultKeeper::Run, this, _1));
-}
-
 void VaultKeeper::Shutdown()
 {
-	thread.request_stop();
-	threadCvar.notify_one();
+	Stop();
 
-	if (thread.joinable())
-		thread.join();
-	thread = {};
+	Task task;
+	TaskQueue::Clock::time_point enqueued;
+	while (TakeLeftover(task, enqueued))
+	{
+		task.Finish(KeeperResult(KeeperError::Cancelled).Pack());
+	}
 
-	tasks.clear();
+	auto queued = mQueueLatency.GetSnapshot();
+	auto run = mRunLatency.GetSnapshot();
+	if (run.count != 0)
+	{
+		Logger::Log("Keeper ran {} tasks, queued p50 {} us p99 {} us, ran p50 {} us p99 {} us", run.count,
+			queued.Percentile(0.5).count(), queued.Percentile(0.99).count(), run.Percentile(0.5).count(), run.Percentile(0.99).count());
+	}
 }
 
-void VaultKeeper::Run(std::stop_token token)
+void VaultKeeper::Execute(Task& task, TaskQueue::Clock::time_point enqueued)
 {
-	std::unique_lock lock(taskMutex);
+	auto start = TaskQueue::Clock::now();
+	mQueueLatency.Record(start - enqueued);
 
-	while (true)
+	auto value = KeeperResult(KeeperError::Cancelled).Pack();
+	auto& stop = task.GetState()->GetStop();
+	auto shutdown = GetStopToken();
+	if (stop.stop_requested() || shutdown.stop_requested())
+		Logger::Log("Skipped cancelled task");
+	else
 	{
-		if (token.stop_requested())
-			return;
-
-		if (tasks.empty())
-		{
-			threadCvar.wait(lock);
-			if (tasks.empty())
-				continue;
-
-			if (token.stop_requested())
-				return;
-		}
-		auto& task = tasks.front();
-
-		lock.unlock();
-		uint64_t value = 0;
-		if (task.func)
-			value = task.func();
-		else if (task.func2)
-			value = task.func2(task.arg);
-		else if (task.func3)
-			value = task.func3(*task.arg2);
-		else if (task.func4)
-			value = task.func4(*task.arg3);
-		lock.lock();
-
-		task.promise.set_value(value);
-		tasks.pop_front();
+		std::stop_callback onShutdown(shutdown, [&stop]() { stop.request_stop(); });
+		mTaskStop = stop.get_token();
+		value = task();
+		mTaskStop = {};
 	}
+	task.Finish(value);
+
+	mRunLatency.Record(TaskQueue::Clock::now() - start);
 }
 
-Future VaultKeeper::SendCmd(const std::function<uint64_t()>& f)
+Future VaultKeeper::SendTask(Task&& task)
 {
-	Task task{ f };
-	auto future = task.promise.get_future();
-
+	auto* state = TaskState::Acquire();
+	task.SetState(state);
+	if (!Post(std::move(task)))
 	{
-		std::lock_guard lock(taskMutex);
-		tasks.push_back(std::move(task));
+		Logger::LogError("Keeper queue is full");
+		task.Finish(KeeperResult(KeeperError::Failed).Pack());
 	}
-	threadCvar.notify_one();
-	return future;
+	return Future(state, &executor);
 }
 
-Future VaultKeeper::SendCmd(const std::function<uint64_t(const SecureArray&)>& f, const SecureArray& arg)
+KeeperResult VaultKeeper::PrepareKdfDeferred()
 {
-	auto mem = Crypto::CopyMemory(arg);
-	if (!mem)
-		return {};
+	auto memory = (uint64_t)vault.GetKdfParams().memory * 1024;
+	auto lease = mKdfScheduler.Acquire(memory, this, mTaskStop);
+	if (!lease)
+		return KeeperError::Cancelled;
 
-	Task task;
-	task.arg = std::move(mem);
-	task.func2 = f;
-	auto future = task.promise.get_future();
+	if (!lease.GetWorkspace()->Reserve((size_t)memory))
+		Logger::LogError("Failed to prepare key derivation memory");
+	else
+		Logger::Log("Prepared key derivation memory, large pages: {}", lease.GetWorkspace()->HasLargePages());
+	return KeeperResult();
+}
 
-	{
-		std::lock_guard lock(taskMutex);
-		tasks.push_back(std::move(task));
-	}
-	threadCvar.notify_one();
-	return future;
+SecureArray VaultKeeper::CreateKey(const std::string_view& password)
+{
+	auto lease = mKdfScheduler.Acquire((uint64_t)vault.GetKdfParams().memory * 1024, this, mTaskStop);
+	if (!lease)
+		return nullptr;
+	return vault.CreateKey(password, mTaskStop, lease.GetWorkspace());
 }
 
-Future VaultKeeper::SendCmd(const std::function<uint64_t(const std::wstring&)>& f, const std::wstring_view& arg)
+bool VaultKeeper::CreateKeys(const std::vector<std::string_view>& passwords, std::vector<SecureArray>& keys)
 {
-	Task task;
-	task.arg2 = arg;
-	task.func3 = f;
-	auto future = task.promise.get_future();
+	keys.clear();
+	if (passwords.empty())
+		return false;
+	keys.resize(passwords.size());
 
+	// no more hashes than the scheduler admits at once, this thread takes a share too
+	auto memory = (uint64_t)vault.GetKdfParams().memory * 1024;
+	auto workers = std::min(passwords.size(), mKdfScheduler.GetCapacity(memory));
+
+	std::atomic_size_t next = 0;
+	auto hash = [this, &passwords, &keys, &next]()
 	{
-		std::lock_guard lock(taskMutex);
-		tasks.push_back(std::move(task));
-	}
-	threadCvar.notify_one();
-	return future;
-}
+		for (size_t i = next++; i < passwords.size(); i = next++)
+			keys[i] = CreateKey(passwords[i]);
+	};
 
-Future VaultKeeper::SendCmd(const std::function<uint64_t(const std::string&)>& f, const std::string_view& arg)
-{
-	Task task;
-	task.arg3 = arg;
-	task.func4 = f;
-	auto future = task.promise.get_future();
+	{
+		std::vector<std::jthread> threads;
+		threads.reserve(workers - 1);
+		for (size_t i = 1; i < workers; ++i)
+			threads.emplace_back(hash);
+		hash();
+	}
 
+	for (auto& key : keys)
 	{
-		std::lock_guard lock(taskMutex);
-		tasks.push_back(std::move(task));
+		if (!key)
+		{
+			keys.clear();
+			return false;
+		}
 	}
-	threadCvar.notify_one();
-	return future;
+	return true;
 }
 
 Future VaultKeeper::OpenVault(const std::wstring_view& file)
 {
-	using namespace std::placeholders;
-	return SendCmd(std::bind(&VaultKeeper::OpenVaultDeferred, this, _1), file);
+	return SendCmd([this, file = std::wstring(file)]() { return OpenVaultDeferred(file); });
 }
 
-uint64_t VaultKeeper::OpenVaultDeferred(const std::wstring& file)
+KeeperResult VaultKeeper::OpenVaultDeferred(const std::wstring& file)
 {
-	auto& vault = game.GetVault();
 	if (!vault.Open(file))
 	{
 		RaiseError(std::format("Failed to open vault {}", StringUtils::WideStringToUtf8(file)));
-		return TaskRet::TR_SwitchToWelcome;
+		return KeeperResult(KeeperError::Failed, VaultStage::Welcome);
 	}
 	Logger::Log(L"Opened vault {}", file);
 
-	Logger::Log("Unlocking first hint");
-	auto key = Crypto::CopyMemory(vault.GetFirstKey());
-	if (!key)
-		return RaiseError("Failed to allocate memory", true);
+	if (!Crypto::IsCipherAvailable(vault.GetCipher()))
+	{
+		RaiseError("Vault is sealed with AES-256-GCM, which this CPU doesn't support");
+		CloseVaultDeferred();
+		return KeeperResult(KeeperError::Failed, VaultStage::Welcome);
+	}
 
+	Logger::Log("Unlocking first hint");
 	SecureArray hint;
-	if (!vault.UnlockStep(key, 0, hint))
+	if (!vault.UnlockStep(vault.GetFirstKey(), 0, hint))
 	{
 		RaiseError("Failed to unlock first hint");
-		return CloseVaultDeferred();
+		CloseVaultDeferred();
+		return KeeperResult(KeeperError::Failed, VaultStage::Welcome);
 	}
 
 	this->file = file;
 	{
 		std::lock_guard lock(hintMutex);
 		mHints.push_back(std::string(hint.str(), hint.size()));
-		mKeyChain.push_back(std::move(key));
 	}
 	Logger::Log("Unlocked first hint");
-	return TaskRet::TR_SwitchToLogin;
+
+	// workspace is faulted in while the password is typed
+	SendCmd([this]() { return PrepareKdfDeferred(); });
+	return VaultStage::Login;
 }
 
 Future VaultKeeper::CreateVault(const std::wstring_view& file)
 {
-	using namespace std::placeholders;
-	return SendCmd(std::bind(&VaultKeeper::CreateVaultDeferred, this, _1), file);
+	return SendCmd([this, file = std::wstring(file)]() { return CreateVaultDeferred(file); });
 }
 
-uint64_t VaultKeeper::CreateVaultDeferred(const std::wstring& file)
+KeeperResult VaultKeeper::CreateVaultDeferred(const std::wstring& file)
 {
-	auto& vault = game.GetVault();
 	Logger::Log("Preparing new vault");
 
 	this->file = file;
@@ -206,16 +192,16 @@ uint64_t VaultKeeper::CreateVaultDeferred(const std::wstring& file)
 	vault.GenerateNew();
 
 	Logger::Log("Prepared new vault");
-	game.GetUnsavedState().NotifyChange();
-	return TaskRet::TR_SwitchToLockSetup;
+	unsavedState.NotifyChange();
+	return VaultStage::LockSetup;
 }
 
 Future VaultKeeper::CloseVault()
 {
-	return SendCmd(std::bind(&VaultKeeper::CloseVaultDeferred, this));
+	return SendCmd([this]() { return CloseVaultDeferred(); });
 }
 
-uint64_t VaultKeeper::CloseVaultDeferred()
+KeeperResult VaultKeeper::CloseVaultDeferred()
 {
 	//if changed, save
 
@@ -225,13 +211,15 @@ uint64_t VaultKeeper::CloseVaultDeferred()
 		mKeyChain.clear();
 	}
 	
-	game.GetVault().Reset();
-	game.GetPassManager().Reset();
+	vault.Reset();
+	passMgr.Reset();
+	mKdfScheduler.ReleaseWorkspaces();
 	this->file = L"vault.bin";
+	mLockChanged = false;
 	Logger::Log("Closed vault");
 
-	game.GetUnsavedState().ClearChange();
-	return TaskRet::TR_SwitchToWelcome;
+	unsavedState.ClearChange();
+	return VaultStage::Welcome;
 }
 
 void VaultKeeper::GetLastHint(std::string& str)
@@ -241,59 +229,31 @@ void VaultKeeper::GetLastHint(std::string& str)
 		str = mHints.back();
 }
 
-Future VaultKeeper::SubmitPassword(const SecureArray& password)
+Future VaultKeeper::SubmitPassword(SecureSpan password)
 {
-	using namespace std::placeholders;
-	return SendCmd(std::bind(&VaultKeeper::SubmitPasswordDeferred, this, _1), password);
+	// task runs after the caller wiped its input, so it needs its own copy
+	auto copy = Crypto::CopyMemory(password);
+	if (!copy)
+		return {};
+	return SendCmd([this, password = std::move(copy)]() { return SubmitPasswordDeferred(password); });
 }
 
-uint64_t VaultKeeper::SubmitPasswordDeferred(const SecureArray& password)
+KeeperResult VaultKeeper::SubmitPasswordDeferred(const SecureArray& password)
 {
 	auto size = strnlen_s(password.str(), password.size());
 	auto pass = std::string_view(password.str(), size);
 	if (pass.empty())
-		return TaskRet::TR_Failed;
+		return KeeperError::Failed;
 
 	Logger::Log("Creating password key");
-	auto& vault = game.GetVault();
-	auto key = vault.CreateKey(pass);
+	auto key = CreateKey(pass);
 	if (!key)
-		return RaiseError("Failed to create password key");
+		return RaiseErrorUnlessCancelled("Failed to create password key");
 
 	// check last hint (next hint doesn't exist, so we can't decrypt it)
-	if (mKeyChain.size() == vault.GetLockSteps())
-	{
-		Logger::Log("Unlocking block");
-
-		SecureArray master;
-		{
-			std::lock_guard lock(hintMutex);
-			master = vault.CreateMasterKey(mKeyChain, key);
-			if (!master)
-				return RaiseError("Failed to create master key", true);
-		}
-		
-		if (!vault.UnlockBlock(master))
-			return RaiseError("Failed to unlock the block");
-
-		{
-			std::lock_guard lock(hintMutex);
-			// delete predef key - create encryptor+hint pairs
-			mKeyChain.erase(mKeyChain.begin());
-			mKeyChain.push_back(std::move(key));
-		}
+	if (mHints.size() == vault.GetLockSteps())
+		return UnlockVault(std::move(key));
 
-		Logger::Log("Deserializing content");
-		auto& passMgr = game.GetPassManager();
-		auto& block = vault.GetBlock();
-		if (!passMgr.Deserialize(std::string_view(block.str(), block.size())))
-			return RaiseError("Failed to deserialize content", true);
-		Logger::Log("Opened vault");
-		
-		vault.ResetCache();
-		game.GetUnsavedState().ClearChange();
-		return TaskRet::TR_SwitchToMainView;
-	}
 	Logger::Log("Unlocking next hint");
 	
 	SecureArray hint;
@@ -306,7 +266,127 @@ uint64_t VaultKeeper::SubmitPasswordDeferred(const SecureArray& password)
 		mKeyChain.push_back(std::move(key));
 	}
 	Logger::Log("Unlocked next hint");
-	return TaskRet::TR_FetchNextHint;
+	return VaultStage::NextHint;
+}
+
+KeeperResult VaultKeeper::UnlockVault(SecureArray&& key)
+{
+	Logger::Log("Unlocking block");
+
+	SecureArray master;
+	{
+		std::lock_guard lock(hintMutex);
+		master = vault.CreateMasterKey(mKeyChain, key);
+		if (!master)
+			return RaiseError("Failed to create master key", true);
+	}
+	
+	if (!vault.UnlockBlock(master, mTaskStop))
+		return RaiseErrorUnlessCancelled("Failed to unlock the block");
+
+	{
+		std::lock_guard lock(hintMutex);
+		// last key completes encryptor+hint pairs
+		mKeyChain.push_back(std::move(key));
+	}
+
+	Logger::Log("Deserializing content");
+	if (vault.GetLayout() == Vault::Layout::Records)
+	{
+		// records are opened on demand, vault cache stays until next save
+		if (!passMgr.Deserialize(vault.GetRecords()))
+			return RaiseError("Failed to deserialize content", true);
+	}
+	else
+	{
+		if (!passMgr.Deserialize(vault.TakeBlock()))
+			return RaiseError("Failed to deserialize content", true);
+	}
+
+	Logger::Log("Replaying journal");
+	if (!passMgr.Replay(vault.TakeJournal()))
+		return RaiseError("Failed to replay journal", true);
+
+	if (vault.GetLayout() != Vault::Layout::Records)
+		vault.ResetCache();
+	Logger::Log("Opened vault");
+	
+	unsavedState.ClearChange();
+	return VaultStage::MainView;
+}
+
+Future VaultKeeper::SubmitPasswords(const std::vector<SecureArray>& passwords)
+{
+	std::vector<SecureArray> copies;
+	copies.reserve(passwords.size());
+	for (auto& password : passwords)
+	{
+		auto copy = Crypto::CopyMemory(password);
+		if (!copy)
+			return {};
+		copies.push_back(std::move(copy));
+	}
+	return SendCmd([this, passwords = std::move(copies)]() { return SubmitPasswordsDeferred(passwords); });
+}
+
+KeeperResult VaultKeeper::SubmitPasswordsDeferred(const std::vector<SecureArray>& passwords)
+{
+	auto start = mHints.size();
+	if (start == 0 || passwords.size() != vault.GetLockSteps() - start + 1)
+		return KeeperError::Failed;
+
+	std::vector<std::string_view> passes;
+	passes.reserve(passwords.size());
+	for (auto& password : passwords)
+	{
+		auto size = strnlen_s(password.str(), password.size());
+		if (size == 0)
+			return KeeperError::Failed;
+		passes.emplace_back(password.str(), size);
+	}
+
+	Logger::Log("Creating {} password keys", passes.size());
+	std::vector<SecureArray> keys;
+	if (!CreateKeys(passes, keys))
+		return RaiseErrorUnlessCancelled("Failed to create password keys");
+
+	// chain is still verified in order, hints up to a wrong password stay unlocked
+	for (size_t i = 0; i + 1 < keys.size(); ++i)
+	{
+		SecureArray hint;
+		if (!vault.UnlockStep(keys[i], (int)(start + i), hint))
+			return RaiseError(std::format("Failed to unlock hint {}", start + i + 1));
+
+		std::lock_guard lock(hintMutex);
+		mHints.push_back(std::string(hint.str(), hint.size()));
+		mKeyChain.push_back(std::move(keys[i]));
+	}
+	Logger::Log("Unlocked all hints");
+
+	return UnlockVault(std::move(keys.back()));
+}
+
+void VaultKeeper::SetKdfMemoryBudget(uint64_t budget)
+{
+	mKdfScheduler.SetBudget(budget);
+}
+
+uint64_t VaultKeeper::GetKdfMemoryBudget()
+{
+	return mKdfScheduler.GetBudget();
+}
+
+size_t VaultKeeper::GetKdfQueuePosition()
+{
+	return mKdfScheduler.GetQueuePosition(this);
+}
+
+int VaultKeeper::GetPendingSteps()
+{
+	std::lock_guard lock(hintMutex);
+	if (mHints.empty())
+		return 0;
+	return (int)(vault.GetLockSteps() - mHints.size() + 1);
 }
 
 void VaultKeeper::AddHint(const std::string_view& hint)
@@ -315,7 +395,8 @@ void VaultKeeper::AddHint(const std::string_view& hint)
 	mHints.push_back(std::string(hint));
 	mKeyChain.resize(mHints.size());
 
-	game.GetUnsavedState().NotifyChange();
+	mLockChanged = true;
+	unsavedState.NotifyChange();
 }
 
 void VaultKeeper::RemoveHint(int i)
@@ -334,49 +415,72 @@ void VaultKeeper::RemoveHint(int i)
 	mHints.erase(it1);
 	mKeyChain.erase(it2);
 
-	game.GetUnsavedState().NotifyChange();
+	mLockChanged = true;
+	unsavedState.NotifyChange();
 }
 
-Future VaultKeeper::SetHintKey(int i, const SecureArray& password)
+Future VaultKeeper::SetHintKey(int i, SecureSpan password)
 {
-	using namespace std::placeholders;
-	return SendCmd(std::bind(&VaultKeeper::SetHintKeyDeferred, this, i, _1), password);
+	auto copy = Crypto::CopyMemory(password);
+	if (!copy)
+		return {};
+	return SendCmd([this, i, password = std::move(copy)]() { return SetHintKeyDeferred(i, password); });
 }
 
-uint64_t VaultKeeper::SetHintKeyDeferred(int i, const SecureArray& password)
+KeeperResult VaultKeeper::SetHintKeyDeferred(int i, const SecureArray& password)
 {
 	if (i >= mKeyChain.size() || i < 0)
-		return TaskRet::TR_Failed;
+		return KeeperError::Failed;
 
 	//this check should be in window
 	auto size = strnlen_s(password.str(), password.size());
 	auto pass = std::string_view(password.str(), size);
 	if (pass.empty())
-		return TaskRet::TR_Failed;
+		return KeeperError::Failed;
 
 	Logger::Log("Creating password key");
-	auto key = game.GetVault().CreateKey(pass);
+	auto key = CreateKey(pass);
 	if (!key)
-		return RaiseError("Failed to create password key");
+		return RaiseErrorUnlessCancelled("Failed to create password key");
 
 	mKeyChain[i] = std::move(key);
 	Logger::Log("Added hint key");
 
-	game.GetUnsavedState().NotifyChange();
-	return TaskRet::TR_Success;
+	mLockChanged = true;
+	unsavedState.NotifyChange();
+	return KeeperResult();
+}
+
+UiTask<KeeperResult> VaultKeeper::SaveVault()
+{
+	return SaveSnapshot(false);
 }
 
-Future VaultKeeper::SaveVault()
+UiTask<KeeperResult> VaultKeeper::CompactVault()
 {
-	return SendCmd(std::bind(&VaultKeeper::SaveVaultDeferred, this, false));
+	return SaveSnapshot(true);
 }
 
-Future VaultKeeper::SaveCloseVault()
+UiTask<KeeperResult> VaultKeeper::SaveSnapshot(bool compact)
 {
-	return SendCmd(std::bind(&VaultKeeper::SaveVaultDeferred, this, true));
+	auto snapshot = passMgr.TakeSnapshot();
+	if (!snapshot)
+		co_return RaiseError("Vault is still being saved");
+
+	auto result = co_await SendCmd([this, snapshot, compact]() { return SaveVaultDeferred(*snapshot, compact); });
+	passMgr.FinishSnapshot(*snapshot, (bool)result);
+	co_return result;
 }
 
-uint64_t VaultKeeper::SaveVaultDeferred(bool close)
+UiTask<KeeperResult> VaultKeeper::SaveThenClose()
+{
+	auto saved = co_await SaveVault();
+	if (!saved)
+		co_return saved;
+	co_return co_await CloseVault();
+}
+
+KeeperResult VaultKeeper::SaveVaultDeferred(const StoreSnapshot& snapshot, bool compact)
 {
 	//these checks should be in window
 	if (mHints.empty())
@@ -387,71 +491,106 @@ uint64_t VaultKeeper::SaveVaultDeferred(bool close)
 		if (!key)
 		{
 			RaiseError("All hint keys must be set");
-			return TaskRet::TR_SwitchToLockSetup;
+			return KeeperResult(KeeperError::Failed, VaultStage::LockSetup);
 		}
 	}
 
+	if (!compact && !mLockChanged && snapshot.journalValid && vault.CanAppend(PassManager::GetJournalSize(snapshot)))
+		return AppendVaultDeferred(snapshot);
+
 	Logger::Log("Serializing content");
-	auto content = game.GetPassManager().Serialize();
-	if (content.empty())
-		return RaiseError("Failed to serialize content");
+	auto layout = vault.GetLayout();
+
+	SecureArray content;
+	std::vector<Vault::Record> records;
+	if (layout == Vault::Layout::Records)
+	{
+		if (!passMgr.SerializeRecords(snapshot, records))
+			return RaiseError("Failed to serialize content");
+	}
+	else
+	{
+		content = passMgr.Serialize(snapshot);
+		if (!content)
+			return RaiseError("Failed to serialize content");
+	}
 
 	std::lock_guard lock(hintMutex);
 	Logger::Log("Placing vault");
 
-	auto& vault = game.GetVault();
+	// every record is loaded now, file is about to be rewritten
+	vault.ResetCache();
 	vault.ResetSteps();
 
-	// move keys - create encryptor+next hint pairs
-	auto key = Crypto::CopyMemory(vault.GetFirstKey());
-	if (!key)
-		return RaiseError("Failed to allocate memory", true);
-	mKeyChain.insert(mKeyChain.begin(), std::move(key));
-
+	// every hint is locked by the key before it, first one by the vault key
 	for (int i = 0; i < mHints.size(); ++i)
 	{
 		auto& hint = mHints[i];
-		auto shint = SecureArray::Wrap(hint.data(), hint.size(), nullptr);
+		auto key = i == 0 ? vault.GetFirstKey() : SecureSpan(mKeyChain[i - 1]);
 
-		if (!vault.AddStep(shint, mKeyChain[i]))
+		if (!vault.AddStep(SecureSpan((const unsigned char*)hint.data(), hint.size()), key))
 		{
-			// move keys - create encryptor+hint pairs
-			mKeyChain.erase(mKeyChain.begin());
-
 			RaiseError("Failed to lock hint");
-			return TaskRet::TR_SwitchToLockSetup;
+			return KeeperResult(KeeperError::Failed, VaultStage::LockSetup);
 		}
 	}
 
-	key = vault.CreateMasterKey(mKeyChain, {});
-	// move keys - create encryptor+hint pairs
-	mKeyChain.erase(mKeyChain.begin());
-
+	auto key = vault.CreateMasterKey(mKeyChain, {});
 	if (!key)
 	{
 		RaiseError("Failed to create master key");
-		return TaskRet::TR_SwitchToLockSetup;
+		return KeeperResult(KeeperError::Failed, VaultStage::LockSetup);
 	}
 
-	if (!vault.LockBlock(key, content))
+	bool locked;
+	if (layout == Vault::Layout::Records)
+		locked = vault.LockRecords(key, records, mTaskStop);
+	else
+		locked = vault.LockBlock(key, std::string_view(content.str(), content.size()), mTaskStop);
+
+	if (!locked)
 	{
+		if (mTaskStop.stop_requested())
+			return KeeperError::Cancelled;
+
 		RaiseError("Failed to lock block");
-		return TaskRet::TR_SwitchToLockSetup;
+		return KeeperResult(KeeperError::Failed, VaultStage::LockSetup);
 	}
 
 	if (!vault.Place(file))
 	{
 		RaiseError(std::format("Failed to place vault in {}", StringUtils::WideStringToUtf8(file)));
-		return TaskRet::TR_SwitchToLockSetup;
+		return KeeperResult(KeeperError::Failed, VaultStage::LockSetup);
 	}
 
 	Logger::Log(L"Placed vault at {}", file);
 
+	// unsaved state is cleared on the ui thread, unless the store changed meanwhile
 	vault.ResetCache();
-	game.GetUnsavedState().ClearChange();
-	if (close)
-		return TaskRet::TR_CloseVault;
-	return TaskRet::TR_SwitchToMainView;
+	mLockChanged = false;
+	return VaultStage::MainView;
+}
+
+KeeperResult VaultKeeper::AppendVaultDeferred(const StoreSnapshot& snapshot)
+{
+	std::lock_guard lock(hintMutex);
+	Logger::Log("Appending changes to vault");
+
+	auto key = vault.CreateMasterKey(mKeyChain, {});
+	if (!key)
+	{
+		RaiseError("Failed to create master key");
+		return KeeperResult(KeeperError::Failed, VaultStage::MainView);
+	}
+
+	if (!vault.AppendJournal(file, key, snapshot.journal))
+	{
+		RaiseError(std::format("Failed to append changes to {}", StringUtils::WideStringToUtf8(file)));
+		return KeeperResult(KeeperError::Failed, VaultStage::MainView);
+	}
+
+	Logger::Log(L"Appended changes to {}", file);
+	return VaultStage::MainView;
 }
 
 int VaultKeeper::GetHintCount()
@@ -475,11 +614,21 @@ bool VaultKeeper::IsKeyAssigned(int i)
 	return mKeyChain[i];
 }
 
-uint64_t VaultKeeper::RaiseError(const std::string_view& msg, bool critical)
+KeeperResult VaultKeeper::RaiseError(const std::string_view& msg, bool critical)
 {
 	Logger::LogError(msg);
-	game.GetMainWindow().ShowError(msg, critical);
-	return critical ? TaskRet::TR_CriticalError : TaskRet::TR_Failed;
+	window.ShowError(msg, critical);
+	return critical ? KeeperError::Critical : KeeperError::Failed;
+}
+
+KeeperResult VaultKeeper::RaiseErrorUnlessCancelled(const std::string_view& msg, bool critical)
+{
+	if (mTaskStop.stop_requested())
+	{
+		Logger::Log("Task cancelled");
+		return KeeperError::Cancelled;
+	}
+	return RaiseError(msg, critical);
 }
 
 void VaultKeeper::LockDirectApi()
@@ -498,17 +647,90 @@ void VaultKeeper::ChangeHint(int i, const std::string_view& hint)
 		return;
 
 	mHints[i] = hint;
-	game.GetUnsavedState().NotifyChange();
+	mLockChanged = true;
+	unsavedState.NotifyChange();
+}
+
+bool VaultKeeper::IsRecordLayout()
+{
+	return vault.GetLayout() == Vault::Layout::Records;
+}
+
+void VaultKeeper::SetRecordLayout(bool enable)
+{
+	vault.SetLayout(enable ? Vault::Layout::Records : Vault::Layout::Stream);
+	mLockChanged = true;
+	unsavedState.NotifyChange();
+}
+
+bool VaultKeeper::IsAesCipher()
+{
+	return vault.GetCipher() == Crypto::Cipher::Aes256Gcm;
+}
+
+void VaultKeeper::SetAesCipher(bool enable)
+{
+	vault.SetCipher(enable ? Crypto::Cipher::Aes256Gcm : Crypto::Cipher::XChaCha20Poly1305);
+	mLockChanged = true;
+	unsavedState.NotifyChange();
+}
+
+Crypto::KdfParams VaultKeeper::GetKdfParams()
+{
+	return vault.GetKdfParams();
+}
+
+LatencyHistogram::Snapshot VaultKeeper::GetQueueLatency() const
+{
+	return mQueueLatency.GetSnapshot();
+}
+
+LatencyHistogram::Snapshot VaultKeeper::GetRunLatency() const
+{
+	return mRunLatency.GetSnapshot();
+}
+
+Future VaultKeeper::CalibrateKdf(std::chrono::milliseconds latency, size_t memoryBudget)
+{
+	return SendCmd([this, latency, memoryBudget]() { return CalibrateKdfDeferred(latency, memoryBudget); });
+}
+
+KeeperResult VaultKeeper::CalibrateKdfDeferred(std::chrono::milliseconds latency, size_t memoryBudget)
+{
+	Logger::Log("Calibrating key derivation");
+	auto lease = mKdfScheduler.Acquire(memoryBudget, this, mTaskStop);
+	if (!lease)
+		return KeeperError::Cancelled;
+
+	auto params = Crypto::CalibrateKdf(latency, memoryBudget, Crypto::DefaultKdfLanes(), mTaskStop);
+	if (mTaskStop.stop_requested())
+		return KeeperError::Cancelled;
+	Logger::Log("Calibrated key derivation to {} passes, {} KiB, {} lanes", params.passes, params.memory, params.lanes);
+
+	// keys made with old costs won't open the vault anymore
+	vault.SetKdfParams(params);
+	{
+		std::lock_guard lock(hintMutex);
+		for (auto& key : mKeyChain)
+		{
+			key.reset();
+		}
+	}
+
+	mLockChanged = true;
+	unsavedState.NotifyChange();
+	return KeeperResult();
 }
 
 void VaultKeeper::ResetSalts()
 {
-	game.GetVault().GenerateNew();
+	vault.GenerateNew();
 	
 	for (auto& key : mKeyChain)
 	{
 		key.reset();
 	}
 
-	game.GetUnsavedState().NotifyChange();
+	mLockChanged = true;
+	unsavedState.NotifyChange();
 }
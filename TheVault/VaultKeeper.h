@@ -2,58 +2,203 @@
 #include <string>
 #include <vector>
 #include <mutex>
-#include <thread>
-#include <condition_variable>
+#include <stop_token>
 #include <future>
-#include <list>
-#include <functional>
+#include <atomic>
+#include <chrono>
 #include "SecureArray.h"
+#include "Crypto.h"
+#include "KdfScheduler.h"
+#include "KeeperTask.h"
+#include "LatencyHistogram.h"
+#include "TaskQueue.h"
+#include "UiExecutor.h"
+#include "UiTask.h"
+#include "WorkerPool.h"
 
-class VaultKeeper
+class Vault;
+class PassManager;
+struct StoreSnapshot;
+class UnsavedState;
+class MainWindow;
+
+enum class VaultStage : uint8_t
+{
+	Unchanged,
+	Welcome,
+	Login,
+	NextHint,
+	MainView,
+	LockSetup,
+};
+
+enum class KeeperError : uint8_t
+{
+	None,
+	Failed, // already reported to the user
+	Cancelled,
+	Critical,
+};
+
+struct KeeperResult
+{
+	KeeperError error;
+	VaultStage stage;
+
+	KeeperResult() : error(KeeperError::None), stage(VaultStage::Unchanged) {}
+	KeeperResult(VaultStage stage) : error(KeeperError::None), stage(stage) {}
+	KeeperResult(KeeperError error, VaultStage stage = VaultStage::Unchanged) : error(error), stage(stage) {}
+
+	explicit operator bool() const { return error == KeeperError::None; }
+
+	uint64_t Pack() const { return (uint64_t)error << 8 | (uint64_t)stage; }
+	static KeeperResult Unpack(uint64_t value) { return KeeperResult((KeeperError)(value >> 8 & 0xff), (VaultStage)(value & 0xff)); }
+};
+
+// commands of one vault, run in order on the shared worker pool
+class VaultKeeper : private WorkerPool::Strand
 {
 public:
-	typedef std::future<uint64_t> Future;
+	// result of a queued task, cancelling drops it from the queue or stops it at its next check
+	class Future
+	{
+	private:
+		TaskState* state;
+		UiExecutor* executor;
+
+		void reset()
+		{
+			if (state)
+				state->Release();
+			state = nullptr;
+		}
+
+	public:
+		Future() : state(nullptr), executor(nullptr) {}
+		Future(TaskState* state, UiExecutor* executor) : state(state), executor(executor) {}
+		Future(const Future& other) = delete;
+		Future& operator=(const Future& other) = delete;
+		Future(Future&& other) noexcept : state(std::exchange(other.state, nullptr)), executor(other.executor) {}
+		Future& operator=(Future&& other) noexcept
+		{
+			if (this != &other)
+			{
+				reset();
+				state = std::exchange(other.state, nullptr);
+				executor = other.executor;
+			}
+			return *this;
+		}
+		~Future() { reset(); }
+
+		bool valid() const { return state != nullptr; }
+		KeeperResult get()
+		{
+			if (!state)
+				return KeeperError::Failed;
+			auto value = state->GetValue();
+			reset();
+			return KeeperResult::Unpack(value);
+		}
+		template<class Rep, class Period>
+		std::future_status wait_for(const std::chrono::duration<Rep, Period>& timeout) const
+		{
+			return state->WaitFor(timeout) ? std::future_status::ready : std::future_status::timeout;
+		}
+		void Cancel()
+		{
+			if (state)
+				state->GetStop().request_stop();
+		}
+
+		// future stays valid while awaited, so the command can still be cancelled
+		auto operator co_await()
+		{
+			struct Awaiter
+			{
+				Future& future;
+
+				bool await_ready() { return !future.state || future.state->IsReady(); }
+				bool await_suspend(std::coroutine_handle<> handle) { return future.state->Await(handle, future.executor); }
+				KeeperResult await_resume() { return future.get(); }
+			};
+			return Awaiter{ *this };
+		}
+	};
 
 private:
+	Vault& vault;
+	PassManager& passMgr;
+	UnsavedState& unsavedState;
+	MainWindow& window;
+	UiExecutor& executor;
+
 	std::vector<std::string> mHints; //protected by hintMutex
 	std::vector<SecureArray> mKeyChain; //protected by hintMutex
 	std::mutex hintMutex;
-	std::wstring file; //used only in the thread
-
-	std::jthread thread;
-	std::condition_variable threadCvar;
-	std::mutex taskMutex;
-	std::list<struct Task> tasks; //protected by taskMutex
-
-	void Run(std::stop_token token);
-	Future SendCmd(const std::function<uint64_t()>& f);
-	Future SendCmd(const std::function<uint64_t(const SecureArray&)>& f, const SecureArray& arg);
-	Future SendCmd(const std::function<uint64_t(const std::wstring&)>& f, const std::wstring_view& arg);
-	Future SendCmd(const std::function<uint64_t(const std::string&)>& f, const std::string_view& arg);
-
-	uint64_t OpenVaultDeferred(const std::wstring& file);
-	uint64_t CreateVaultDeferred(const std::wstring& file);
-	uint64_t CloseVaultDeferred();
-	uint64_t SubmitPasswordDeferred(const SecureArray& password);
-	uint64_t SetHintKeyDeferred(int i, const SecureArray& password);
-	uint64_t SaveVaultDeferred(bool close);
+	std::wstring file; //used only in the strand
+	std::atomic_bool mLockChanged; // hints or keys changed, journal can't be used
+	KdfScheduler& mKdfScheduler;
+
+	std::stop_token mTaskStop; //used only in the strand, stop of running task
+	LatencyHistogram mQueueLatency;
+	LatencyHistogram mRunLatency;
+
+	void Execute(Task& task, TaskQueue::Clock::time_point enqueued) override;
+	Future SendTask(Task&& task);
+	template<typename F>
+	Future SendCmd(F&& fn)
+	{
+		return SendTask(Task([fn = std::forward<F>(fn)]() mutable { return fn().Pack(); }));
+	}
+
+	KeeperResult PrepareKdfDeferred();
+	SecureArray CreateKey(const std::string_view& password);
+	bool CreateKeys(const std::vector<std::string_view>& passwords, std::vector<SecureArray>& keys);
+
+	KeeperResult OpenVaultDeferred(const std::wstring& file);
+	KeeperResult CreateVaultDeferred(const std::wstring& file);
+	KeeperResult CloseVaultDeferred();
+	KeeperResult SubmitPasswordDeferred(const SecureArray& password);
+	KeeperResult SubmitPasswordsDeferred(const std::vector<SecureArray>& passwords);
+	KeeperResult UnlockVault(SecureArray&& key);
+	KeeperResult RaiseErrorUnlessCancelled(const std::string_view& msg, bool critical = false);
+	KeeperResult SetHintKeyDeferred(int i, const SecureArray& password);
+	UiTask<KeeperResult> SaveSnapshot(bool compact);
+	KeeperResult SaveVaultDeferred(const StoreSnapshot& snapshot, bool compact);
+	KeeperResult AppendVaultDeferred(const StoreSnapshot& snapshot);
+	KeeperResult CalibrateKdfDeferred(std::chrono::milliseconds latency, size_t memoryBudget);
 
 public:
-	VaultKeeper();
+	VaultKeeper(Vault& vault, PassManager& passMgr, UnsavedState& unsavedState, MainWindow& window, UiExecutor& executor, WorkerPool& pool, KdfScheduler& kdfScheduler);
 	~VaultKeeper();
 
-	void Init();
 	void Shutdown();
 
 	Future OpenVault(const std::wstring_view& file);
 	Future CreateVault(const std::wstring_view& file);
 	Future CloseVault();
-	Future SaveVault();
-	Future SaveCloseVault();
+	UiTask<KeeperResult> SaveVault();
+	UiTask<KeeperResult> CompactVault();
+	UiTask<KeeperResult> SaveThenClose();
 
 	void GetLastHint(std::string& str);
-	Future SubmitPassword(const SecureArray& password);
+	Future SubmitPassword(SecureSpan password);
+	// passwords for every remaining hint, keys are derived concurrently
+	Future SubmitPasswords(const std::vector<SecureArray>& passwords);
+	int GetPendingSteps();
+	void SetKdfMemoryBudget(uint64_t budget);
+	uint64_t GetKdfMemoryBudget();
+	size_t GetKdfQueuePosition();
 	void ResetSalts();
+	bool IsRecordLayout();
+	void SetRecordLayout(bool enable);
+	bool IsAesCipher();
+	void SetAesCipher(bool enable);
+	Crypto::KdfParams GetKdfParams();
+	LatencyHistogram::Snapshot GetQueueLatency() const;
+	LatencyHistogram::Snapshot GetRunLatency() const;
+	Future CalibrateKdf(std::chrono::milliseconds latency, size_t memoryBudget);
 
 	// direct api for LockSetup
 	void LockDirectApi();
@@ -63,8 +208,8 @@ public:
 	bool IsKeyAssigned(int i);
 	void AddHint(const std::string_view& hint);
 	void RemoveHint(int i);
-	Future SetHintKey(int i, const SecureArray& password);
+	Future SetHintKey(int i, SecureSpan password);
 	void ChangeHint(int i, const std::string_view& hint);
 	
-	uint64_t RaiseError(const std::string_view& msg, bool critical = false);
+	KeeperResult RaiseError(const std::string_view& msg, bool critical = false);
 };
@@ -0,0 +1,151 @@
+#include <format>
+#include <imgui.h>
+#include "VaultSession.h"
+#include "Engine/Logger.h"
+
+constexpr size_t NoInstance = (size_t)-1;
+
+VaultInstance::VaultInstance(WorkerPool& pool, KdfScheduler& kdfScheduler)
+	: passMgr(vault, unsavedState), window(*this), keeper(vault, passMgr, unsavedState, window, executor, pool, kdfScheduler)
+{
+}
+
+VaultSession::VaultSession()
+{
+	mNextId = 1;
+	mActive = 0;
+	mNextActive = 0;
+	mClosing = NoInstance;
+	mSelectTab = false;
+}
+
+VaultSession::~VaultSession()
+{
+	Shutdown();
+}
+
+bool VaultSession::Initialize()
+{
+	if (!Open())
+		return false;
+	mActive = mNextActive;
+	return true;
+}
+
+void VaultSession::Shutdown()
+{
+	for (size_t i = 0; i < mInstances.size(); ++i)
+		Stop(i);
+	pool.Shutdown();
+}
+
+bool VaultSession::Open()
+{
+	if (mInstances.size() >= MaxInstances)
+		return false;
+
+	auto instance = std::make_unique<VaultInstance>(pool, kdfScheduler);
+	if (!instance->vault.Initialize())
+	{
+		Logger::LogError("Failed to initialize vault");
+		return false;
+	}
+	instance->window.Initialize();
+
+	mInstances.push_back(std::move(instance));
+	mIds.push_back(mNextId++);
+	SetActive(mInstances.size() - 1);
+	Logger::Log("Opened vault tab {}", mIds.back());
+	return true;
+}
+
+void VaultSession::Close(size_t i)
+{
+	if (i < mInstances.size() && mInstances.size() > 1)
+		mClosing = i;
+}
+
+void VaultSession::SetActive(size_t i)
+{
+	if (i >= mInstances.size() || i == mNextActive)
+		return;
+	mNextActive = i;
+	mSelectTab = true;
+}
+
+void VaultSession::Apply()
+{
+	if (mClosing != NoInstance)
+	{
+		auto i = mClosing;
+		mClosing = NoInstance;
+
+		Stop(i);
+		Logger::Log("Closed vault tab {}", mIds[i]);
+		mInstances.erase(mInstances.begin() + i);
+		mIds.erase(mIds.begin() + i);
+
+		if (mNextActive > i || mNextActive == mInstances.size())
+			--mNextActive;
+		mSelectTab = true;
+	}
+
+	mActive = mNextActive;
+}
+
+void VaultSession::Stop(size_t i)
+{
+	// cancelled commands still resume their coroutines, so no frame is left suspended
+	auto& instance = *mInstances[i];
+	instance.keeper.Shutdown();
+	instance.executor.Pump();
+}
+
+void VaultSession::Render()
+{
+	Apply();
+
+	// background saves and unlocks of hidden vaults still have to finish
+	for (auto& instance : mInstances)
+		instance->executor.Pump();
+	GetActive().window.Render();
+}
+
+void VaultSession::RenderTabs()
+{
+	if (!ImGui::BeginTabBar("##Vaults", ImGuiTabBarFlags_FittingPolicyScroll))
+		return;
+
+	auto selectTab = mSelectTab;
+	mSelectTab = false;
+
+	for (size_t i = 0; i < mInstances.size(); ++i)
+	{
+		auto& instance = *mInstances[i];
+		bool open = true;
+		bool closable = mInstances.size() > 1 && instance.window.IsIdle();
+
+		ImGuiTabItemFlags flags = ImGuiTabItemFlags_None;
+		if (instance.unsavedState.HasChanged())
+			flags |= ImGuiTabItemFlags_UnsavedDocument;
+		if (selectTab && i == mNextActive)
+			flags |= ImGuiTabItemFlags_SetSelected;
+
+		auto label = std::format("Vault {}", mIds[i]);
+		if (ImGui::BeginTabItem(label.c_str(), closable ? &open : nullptr, flags))
+		{
+			// selection made by code shows up a frame later, don't undo it meanwhile
+			if (!selectTab)
+				SetActive(i);
+			ImGui::EndTabItem();
+		}
+
+		if (!open)
+			Close(i);
+	}
+
+	if (mInstances.size() < MaxInstances && ImGui::TabItemButton("+", ImGuiTabItemFlags_Trailing | ImGuiTabItemFlags_NoTooltip))
+		Open();
+
+	ImGui::EndTabBar();
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "GUI/IRender.h"
+#include "GUI/Objects/MainWindow.h"
+#include "Vault.h"
+#include "VaultKeeper.h"
+#include "PassManager.h"
+#include "UnsavedState.h"
+#include "KdfScheduler.h"
+#include "UiExecutor.h"
+#include "WorkerPool.h"
+
+// its windows and coroutines reach it directly, so they work the same while it is hidden
+// keeper is the last member, so it is stopped before anything it uses is gone
+class VaultInstance
+{
+public:
+	Vault vault;
+	UnsavedState unsavedState;
+	PassManager passMgr;
+	UiExecutor executor;
+	MainWindow window;
+	VaultKeeper keeper;
+
+	VaultInstance(WorkerPool& pool, KdfScheduler& kdfScheduler);
+	VaultInstance(const VaultInstance&) = delete;
+	VaultInstance& operator=(const VaultInstance&) = delete;
+};
+
+// only the active instance is rendered, switching takes effect on the next frame
+class VaultSession : public IRender
+{
+private:
+	WorkerPool pool;
+	KdfScheduler kdfScheduler;
+	std::vector<std::unique_ptr<VaultInstance>> mInstances;
+	std::vector<int> mIds; // tab ids, stay the same when other tabs close
+	int mNextId;
+	size_t mActive;
+	size_t mNextActive;
+	size_t mClosing; // closed at the start of next frame
+	bool mSelectTab;
+
+	void Apply();
+	void Stop(size_t i);
+
+public:
+	static constexpr size_t MaxInstances = 8;
+
+	VaultSession();
+	~VaultSession();
+
+	bool Initialize();
+	void Shutdown();
+	void Render() override;
+	void RenderTabs();
+
+	bool Open();
+	void Close(size_t i);
+	void SetActive(size_t i);
+
+	size_t GetCount() { return mInstances.size(); }
+	VaultInstance& GetActive() { return *mInstances[mActive]; }
+	VaultInstance& GetInstance(size_t i) { return *mInstances[i]; }
+	KdfScheduler& GetKdfScheduler() { return kdfScheduler; }
+	WorkerPool& GetPool() { return pool; }
+};
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <Windows.h>
 #define GF_INCLUDE_WNDMGR
 #include "Engine/GhostFries.h"
@@ -50,3 +51,96 @@ bool WinApi::SaveFileDialog(const wchar_t* title, const std::wstring_view& defau
 	path.clear();
 	return false;
 }
+
+bool WinApi::WriteFileAt(const std::wstring_view& file, uint64_t offset, const unsigned char* data, size_t size)
+{
+	auto path = std::wstring(file);
+	HANDLE hFile = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER pos;
+	pos.QuadPart = (LONGLONG)offset;
+	bool result = SetFilePointerEx(hFile, pos, nullptr, FILE_BEGIN);
+
+	while (result && size > 0)
+	{
+		DWORD written;
+		auto chunk = (DWORD)std::min<size_t>(size, MAXDWORD);
+		result = WriteFile(hFile, data, chunk, &written, nullptr) && written == chunk;
+		data += chunk;
+		size -= chunk;
+	}
+
+	if (result)
+		result = FlushFileBuffers(hFile);
+
+	CloseHandle(hFile);
+	return result;
+}
+
+uint64_t WinApi::GetAvailableMemory()
+{
+	MEMORYSTATUSEX status{};
+	status.dwLength = sizeof(status);
+	if (!GlobalMemoryStatusEx(&status))
+		return 0;
+	return status.ullAvailPhys;
+}
+
+static bool EnableLockMemoryPrivilege()
+{
+	HANDLE token;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+		return false;
+
+	TOKEN_PRIVILEGES privileges{};
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	bool enabled = LookupPrivilegeValueW(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+		AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) && GetLastError() == ERROR_SUCCESS;
+
+	CloseHandle(token);
+	return enabled;
+}
+
+void* WinApi::AllocWorkspace(size_t size, bool& largePages)
+{
+	// privilege is only granted by policy, so it is tried once per process
+	static const bool canLock = EnableLockMemoryPrivilege();
+
+	auto largePage = GetLargePageMinimum();
+	if (canLock && largePage != 0 && size % largePage == 0)
+	{
+		void* memory = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if (memory)
+		{
+			largePages = true;
+			return memory;
+		}
+	}
+
+	void* memory = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (!memory)
+		return nullptr;
+
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	auto* bytes = (volatile unsigned char*)memory;
+	for (size_t i = 0; i < size; i += info.dwPageSize)
+		bytes[i] = 0;
+
+	largePages = false;
+	return memory;
+}
+
+void WinApi::FreeWorkspace(void* memory)
+{
+	if (memory)
+		VirtualFree(memory, 0, MEM_RELEASE);
+}
+
+size_t WinApi::GetLargePageSize()
+{
+	return GetLargePageMinimum();
+}
@@ -5,4 +5,10 @@ namespace WinApi
 {
 	bool OpenFileDialog(const wchar_t* title, const std::wstring_view& defaultName, std::wstring& path);
 	bool SaveFileDialog(const wchar_t* title, const std::wstring_view& defaultName, std::wstring& path);
+	bool WriteFileAt(const std::wstring_view& file, uint64_t offset, const unsigned char* data, size_t size);
+	uint64_t GetAvailableMemory();
+	// large pages need SeLockMemoryPrivilege, otherwise normal pages are faulted in up front
+	void* AllocWorkspace(size_t size, bool& largePages);
+	void FreeWorkspace(void* memory);
+	size_t GetLargePageSize();
 }
@@ -0,0 +1,149 @@
+#include <functional>
+#include "WorkerPool.h"
+#include "Engine/Logger.h"
+
+WorkerPool::Strand::Strand(WorkerPool& pool, size_t capacity) : mPool(pool), mQueue(capacity)
+{
+	mPending = 0;
+	mDrainers = 0;
+}
+
+WorkerPool::Strand::~Strand()
+{
+}
+
+static thread_local WorkerPool::Strand* draining = nullptr;
+
+bool WorkerPool::Strand::Post(Task&& task)
+{
+	// counted before the push, so the strand is never idle while a task is queued
+	// only the post that finds it idle hands it to the pool
+	bool idle = mPending.fetch_add(1) == 0;
+	if (draining == this)
+	{
+		// nobody would free a cell while the strand waits on its own queue
+		if (!mQueue.TryPush(task))
+		{
+			mPending.fetch_sub(1);
+			return false;
+		}
+	}
+	else
+		mQueue.Push(std::move(task));
+
+	if (idle)
+		mPool.Schedule(this);
+	return true;
+}
+
+void WorkerPool::Strand::Drain()
+{
+	Task task;
+	TaskQueue::Clock::time_point enqueued;
+	draining = this;
+	do
+	{
+		// task is counted but its push isn't finished yet
+		while (!mQueue.TryPop(task, enqueued))
+			std::this_thread::yield();
+
+		Execute(task, enqueued);
+		task.reset();
+	} while (mPending.fetch_sub(1) != 1);
+	draining = nullptr;
+}
+
+void WorkerPool::Strand::Stop()
+{
+	mStop.request_stop();
+	mPool.WaitIdle(this);
+}
+
+bool WorkerPool::Strand::TakeLeftover(Task& task, TaskQueue::Clock::time_point& enqueued)
+{
+	// tasks are left only if the pool was shut down first, nobody drains the strand then
+	return mQueue.TryPop(task, enqueued);
+}
+
+WorkerPool::WorkerPool()
+{
+	mIdle = 0;
+	mStopped = false;
+}
+
+WorkerPool::~WorkerPool()
+{
+	Shutdown();
+}
+
+void WorkerPool::Shutdown()
+{
+	std::vector<std::jthread> threads;
+	{
+		std::lock_guard lock(mutex);
+		mStopped = true;
+		threads.swap(mThreads);
+		mReady.clear();
+	}
+	idleCvar.notify_all();
+
+	for (auto& thread : threads)
+		thread.request_stop();
+	threads.clear();
+}
+
+size_t WorkerPool::GetThreadCount()
+{
+	std::lock_guard lock(mutex);
+	return mThreads.size();
+}
+
+void WorkerPool::Run(std::stop_token token)
+{
+	std::unique_lock lock(mutex);
+	while (true)
+	{
+		++mIdle;
+		bool ready = cvar.wait(lock, token, [this]() { return !mReady.empty(); });
+		--mIdle;
+		if (!ready)
+			return;
+
+		auto* strand = mReady.front();
+		mReady.pop_front();
+		++strand->mDrainers;
+
+		lock.unlock();
+		strand->Drain();
+		lock.lock();
+
+		// strand isn't touched after this, stopping it may free it
+		--strand->mDrainers;
+		idleCvar.notify_all();
+	}
+}
+
+void WorkerPool::Schedule(Strand* strand)
+{
+	std::lock_guard lock(mutex);
+	if (mStopped)
+		return;
+
+	mReady.push_back(strand);
+	if (mReady.size() > mIdle)
+	{
+		using namespace std::placeholders;
+		mThreads.emplace_back(std::bind(&WorkerPool::Run, this, _1));
+		Logger::Log("Started worker {}", mThreads.size());
+	}
+	cvar.notify_one();
+}
+
+void WorkerPool::WaitIdle(Strand* strand)
+{
+	std::unique_lock lock(mutex);
+	idleCvar.wait(lock, [this, strand]()
+	{
+		return strand->mDrainers == 0 && (mStopped || strand->mPending.load() == 0);
+	});
+}
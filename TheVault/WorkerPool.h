@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+#include "KeeperTask.h"
+#include "TaskQueue.h"
+
+// threads shared by every open vault, a worker is added only when all of them are busy
+// so a strand stuck in a long hash never holds back another strand
+class WorkerPool
+{
+public:
+	class Strand
+	{
+	private:
+		WorkerPool& mPool;
+		TaskQueue mQueue;
+		std::atomic_size_t mPending; // posted and not finished, strand is scheduled while nonzero
+		int mDrainers; //protected by pool mutex
+		std::stop_source mStop;
+
+		friend class WorkerPool;
+		void Drain();
+
+	protected:
+		virtual void Execute(Task& task, TaskQueue::Clock::time_point enqueued) = 0;
+
+		// from inside the strand it fails on a full queue instead of waiting, task is left as it is then
+		bool Post(Task&& task);
+		// requests stop and waits until the strand leaves its worker
+		// queued tasks still go through Execute, which should only cancel them now
+		void Stop();
+		bool TakeLeftover(Task& task, TaskQueue::Clock::time_point& enqueued);
+		std::stop_token GetStopToken() { return mStop.get_token(); }
+
+	public:
+		Strand(WorkerPool& pool, size_t capacity);
+		Strand(const Strand&) = delete;
+		Strand& operator=(const Strand&) = delete;
+		virtual ~Strand();
+	};
+
+private:
+	std::mutex mutex;
+	std::condition_variable_any cvar;
+	std::condition_variable idleCvar;
+	std::deque<Strand*> mReady; //protected by mutex
+	std::vector<std::jthread> mThreads; //protected by mutex
+	size_t mIdle; //protected by mutex
+	bool mStopped; //protected by mutex
+
+	void Run(std::stop_token token);
+	void Schedule(Strand* strand);
+	void WaitIdle(Strand* strand);
+
+public:
+	WorkerPool();
+	~WorkerPool();
+
+	void Shutdown();
+	size_t GetThreadCount();
+};